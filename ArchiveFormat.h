@@ -0,0 +1,400 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+/* how a chunk is kept in the archive */
+enum class ChunkType : uint8_t
+{
+    Deflated = 0,   /// zlib stream
+    Stored = 1,     /// raw bytes, the chunk didn't shrink with deflate
+    Fill = 2,       /// every byte is the chunk parameter, no payload
+    Reference = 3,  /// same bytes as an earlier chunk, no payload, the FAT references give the chunk
+    Solid = 4,      /// part of the raw deflate stream of its solid group, inflated after the Solid chunks before it
+};
+
+/* On-disk layout of a compressed .forge archive, shared by the PC tools and the xb1 decompressor.
+
+       [ArchiveHeader][dictionary][chunk payloads][FAT][asset index][ArchiveFooter]
+
+   The dictionary is the preset dictionary of every Deflated chunk and of the stream of every solid group,
+   m_dictionarySize bytes trained on the input, none when m_dictionarySize is 0.
+
+   The FAT is split in six arrays:
+       - checkpoints: one uint64_t absolute file offset every CHECKPOINT_INTERVAL chunks, plus one for the
+         end of the last chunk
+       - deltas: per chunk, the offset of the chunk from its checkpoint, bit packed on m_deltaBits bits
+       - types: one uint8_t chunk type per chunk
+       - parameters: one uint8_t per chunk, the byte of Fill chunks, the deflate level and strategy of Deflated
+         chunks (see deflateParameter), only there for statistics since inflate doesn't need them
+       - checksums: one ChunkChecksums per chunk
+       - references: one ChunkReference per Reference chunk, sorted by chunk index
+   so a chunk offset is one checkpoint plus one delta whatever the archive size. That is about 13 bytes per chunk,
+   the 8 of the checksums, 2 or 3 of the delta and one each for the type and the parameter, plus 16 per Reference
+   chunk.
+
+   With m_solidChunksCount > 1 the chunks are grouped by m_solidChunksCount from the first one and the Solid
+   chunks of a group are a single raw deflate stream sharing its window. Each Solid chunk ends on a
+   Z_SYNC_FLUSH so its payload is a byte range of the stream like any other chunk, a group is the unit of
+   random access and a new group restarts the stream with an empty window.
+
+   The asset index is only there for packs of several files (FLAG_ASSET_INDEX), the files are laid out one
+   after the other, each starting on a chunk boundary, and the index maps their names to their range:
+       [AssetIndexHeader][uint32_t seed per bucket][uint32_t asset per slot][AssetEntry per asset][uint16_t names]
+   The footer repeats the header so an archive opens with a single read of its tail. Every field is fixed
+   width little endian. */
+namespace ArchiveFormat
+{
+    static const uint32_t HEADER_MAGIC = 0x5A475246;    /// "FRGZ"
+    static const uint32_t FOOTER_MAGIC = 0x5441465A;    /// "ZFAT"
+    static const uint16_t VERSION = 8;
+
+    static const uint64_t CHECKPOINT_INTERVAL = 64;
+
+    /// a preset dictionary is only useful up to the deflate window
+    static const uint32_t MAX_DICTIONARY_SIZE = 32 * 1024;
+
+    /// a delta is read with one unaligned 64 bit load, shifted by up to 7 bits
+    static const uint32_t MAX_DELTA_BITS = 56;
+
+    /* how the chunk payloads are encoded */
+    enum Codec : uint16_t
+    {
+        CODEC_ZLIB = 1,
+    };
+
+    /* archive wide features a reader has to understand */
+    static const uint32_t FLAG_ASSET_INDEX = 1;     /// a pack of files, an asset index follows the FAT
+    static const uint32_t KNOWN_FLAGS = FLAG_ASSET_INDEX;
+
+    /// an asset index slot no asset hashes to
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+#pragma pack(push, 1)
+    /* CRC32C of a chunk as stored in the archive and once decompressed, both the same for stored chunks */
+    struct ChunkChecksums
+    {
+        uint32_t m_compressed;
+        uint32_t m_decompressed;
+    };
+
+    /* a Reference chunk and the earlier Deflated, Stored or Solid chunk holding its bytes */
+    struct ChunkReference
+    {
+        uint64_t m_chunkIndex;
+        uint64_t m_referencedChunk;
+    };
+
+    struct AssetIndexHeader
+    {
+        uint64_t m_assetsCount;
+        uint64_t m_bucketsCount;
+        uint64_t m_slotsCount;
+        uint64_t m_namesSize;       /// in uint16_t
+    };
+
+    /* an asset of a pack, m_offset and m_size locate it in the decompressed pack, its name is UTF-16 */
+    struct AssetEntry
+    {
+        uint64_t m_offset;
+        uint64_t m_size;
+        uint64_t m_nameOffset;      /// in uint16_t
+        uint32_t m_nameSize;        /// in uint16_t
+        uint32_t m_reserved;
+    };
+
+    struct ArchiveHeader
+    {
+        uint32_t m_magic;
+        uint16_t m_version;
+        uint16_t m_codec;
+        uint32_t m_chunkSize;
+        uint32_t m_solidChunksCount;    /// chunks per solid group, 1 when every chunk is on its own
+        uint32_t m_dictionarySize;
+        uint32_t m_flags;
+        uint64_t m_originalFileSize;
+        uint64_t m_chunksCount;
+    };
+
+    struct ArchiveFooter
+    {
+        ArchiveHeader m_header;
+        uint64_t m_fatOffset;
+        uint64_t m_fatSize;
+        uint64_t m_referencesCount;
+        uint64_t m_indexSize;
+        uint32_t m_deltaBits;
+        uint32_t m_magic;
+    };
+#pragma pack(pop)
+
+    inline uint64_t chunksCount(uint64_t originalFileSize, uint32_t chunkSize)
+    {
+        return originalFileSize / chunkSize + (originalFileSize % chunkSize != 0 ? 1 : 0);
+    }
+
+    inline uint64_t checkpointsCount(uint64_t chunksCount)
+    {
+        return (chunksCount + CHECKPOINT_INTERVAL - 1) / CHECKPOINT_INTERVAL + 1;
+    }
+
+    /* bytes of the packed deltas, rounded up to whole words plus a spare one so the last delta reads in one load */
+    inline uint64_t deltasSize(uint64_t chunksCount, uint32_t deltaBits)
+    {
+        /// whole words of 64 chunks first, chunksCount * deltaBits alone can wrap
+        return ((chunksCount / 64) * deltaBits + ((chunksCount % 64) * deltaBits + 63) / 64 + 1) * sizeof(uint64_t);
+    }
+
+    inline uint64_t fatSize(uint64_t chunksCount, uint32_t deltaBits, uint64_t referencesCount)
+    {
+        return checkpointsCount(chunksCount) * sizeof(uint64_t) + deltasSize(chunksCount, deltaBits) + 2 * chunksCount * sizeof(uint8_t)
+            + chunksCount * sizeof(ChunkChecksums) + referencesCount * sizeof(ChunkReference);
+    }
+
+    /* whether the FAT of these counts takes exactly fatSize bytes. The counts come from the file and may be
+       anything, each array is checked against the bytes left before it is subtracted so nothing wraps */
+    inline bool isFatSize(uint64_t fatSize, uint64_t chunksCount, uint32_t deltaBits, uint64_t referencesCount)
+    {
+        const uint64_t chunkBytes = 2 * sizeof(uint8_t) + sizeof(ChunkChecksums);
+        uint64_t remaining = fatSize;
+
+        if (chunksCount > remaining / chunkBytes)
+        {
+            return false;
+        }
+        remaining -= chunksCount * chunkBytes;
+
+        if (referencesCount > remaining / sizeof(ChunkReference))
+        {
+            return false;
+        }
+        remaining -= referencesCount * sizeof(ChunkReference);
+
+        /// chunksCount is below 2^64 / chunkBytes from here, the checkpoints and the deltas can't wrap
+        const uint64_t checkpointsSize = checkpointsCount(chunksCount) * sizeof(uint64_t);
+
+        if (checkpointsSize > remaining)
+        {
+            return false;
+        }
+        remaining -= checkpointsSize;
+
+        return deltasSize(chunksCount, deltaBits) == remaining;
+    }
+
+    /* bits needed to store value */
+    inline uint32_t bitsCount(uint64_t value)
+    {
+        uint32_t bits = 0;
+
+        while (bits < 64 && (value >> bits) != 0)
+        {
+            ++bits;
+        }
+
+        return bits;
+    }
+
+    /* Lookups in a FAT laid out as above, usually straight from a file mapping. Nothing is copied or decoded
+       up front, a lookup only touches the checkpoint and the delta of the chunk. */
+    struct FatView
+    {
+        FatView() : m_checkpoints(nullptr), m_deltas(nullptr), m_types(nullptr), m_parameters(nullptr), m_checksums(nullptr), m_references(nullptr),
+            m_chunksCount(0), m_referencesCount(0), m_deltaBits(0) {}
+
+        FatView(const uint8_t* fat, uint64_t chunksCount, uint32_t deltaBits, uint64_t referencesCount)
+            : m_checkpoints(fat)
+            , m_deltas(fat + checkpointsCount(chunksCount) * sizeof(uint64_t))
+            , m_types(m_deltas + deltasSize(chunksCount, deltaBits))
+            , m_parameters(m_types + chunksCount * sizeof(uint8_t))
+            , m_checksums(m_parameters + chunksCount * sizeof(uint8_t))
+            , m_references(m_checksums + chunksCount * sizeof(ChunkChecksums))
+            , m_chunksCount(chunksCount)
+            , m_referencesCount(referencesCount)
+            , m_deltaBits(deltaBits)
+        {
+        }
+
+        uint64_t checkpoint(uint64_t checkpointIndex) const
+        {
+            uint64_t offset;
+            memcpy(&offset, m_checkpoints + checkpointIndex * sizeof(uint64_t), sizeof(offset));
+
+            return offset;
+        }
+
+        uint64_t delta(uint64_t chunkIndex) const
+        {
+            uint64_t bitOffset = chunkIndex * m_deltaBits;
+            uint64_t word;
+            memcpy(&word, m_deltas + bitOffset / 8, sizeof(word));
+
+            return (word >> (bitOffset % 8)) & ((uint64_t(1) << m_deltaBits) - 1);
+        }
+
+        /* absolute offset of the chunk in the archive, chunkIndex == chunksCount gives the end of the last chunk */
+        uint64_t chunkOffset(uint64_t chunkIndex) const
+        {
+            if (chunkIndex == m_chunksCount)
+            {
+                return checkpoint(checkpointsCount(m_chunksCount) - 1);
+            }
+
+            return checkpoint(chunkIndex / CHECKPOINT_INTERVAL) + delta(chunkIndex);
+        }
+
+        ChunkType chunkType(uint64_t chunkIndex) const
+        {
+            return static_cast<ChunkType>(m_types[chunkIndex]);
+        }
+
+        uint8_t chunkParameter(uint64_t chunkIndex) const
+        {
+            return m_parameters[chunkIndex];
+        }
+
+        ChunkChecksums chunkChecksums(uint64_t chunkIndex) const
+        {
+            ChunkChecksums checksums;
+            memcpy(&checksums, m_checksums + chunkIndex * sizeof(ChunkChecksums), sizeof(checksums));
+
+            return checksums;
+        }
+
+        ChunkReference reference(uint64_t referenceIndex) const
+        {
+            ChunkReference reference;
+            memcpy(&reference, m_references + referenceIndex * sizeof(ChunkReference), sizeof(reference));
+
+            return reference;
+        }
+
+        /* binary search of the Reference chunk chunkIndex in the references, false if it has none */
+        bool referencedChunk(uint64_t chunkIndex, uint64_t& referencedChunk) const
+        {
+            uint64_t first = 0;
+            uint64_t last = m_referencesCount;
+
+            while (first < last)
+            {
+                uint64_t middle = first + (last - first) / 2;
+                ChunkReference middleReference = reference(middle);
+
+                if (middleReference.m_chunkIndex == chunkIndex)
+                {
+                    referencedChunk = middleReference.m_referencedChunk;
+                    return true;
+                }
+
+                if (middleReference.m_chunkIndex < chunkIndex)
+                {
+                    first = middle + 1;
+                }
+                else
+                {
+                    last = middle;
+                }
+            }
+
+            return false;
+        }
+
+        const uint8_t* m_checkpoints;
+        const uint8_t* m_deltas;
+        const uint8_t* m_types;
+        const uint8_t* m_parameters;
+        const uint8_t* m_checksums;
+        const uint8_t* m_references;
+        uint64_t m_chunksCount;
+        uint64_t m_referencesCount;
+        uint32_t m_deltaBits;
+    };
+
+    /* parameter of a Deflated chunk, the zlib strategy in the high nibble and the level in the low one */
+    inline uint8_t deflateParameter(int level, int strategy)
+    {
+        return static_cast<uint8_t>(strategy << 4 | level);
+    }
+
+    inline int deflateLevel(uint8_t parameter)
+    {
+        return parameter & 0x0F;
+    }
+
+    inline int deflateStrategy(uint8_t parameter)
+    {
+        return parameter >> 4;
+    }
+
+    /* smallest delta width able to describe these chunksCount + 1 offsets */
+    inline uint32_t deltaBits(const uint64_t* chunksOffsets, uint64_t chunksCount)
+    {
+        uint64_t maxDelta = 0;
+
+        for (uint64_t i = 0; i < chunksCount; ++i)
+        {
+            uint64_t delta = chunksOffsets[i] - chunksOffsets[i - i % CHECKPOINT_INTERVAL];
+            maxDelta = delta > maxDelta ? delta : maxDelta;
+        }
+
+        return bitsCount(maxDelta);
+    }
+
+    /* lays out the FAT of chunksCount + 1 absolute offsets, chunksCount types, parameters and checksums and the
+       references into fat, fatSize(chunksCount, deltaBits, referencesCount) zeroed bytes */
+    inline void encodeFat(const uint64_t* chunksOffsets, const ChunkType* chunksTypes, const uint8_t* chunksParameters,
+        const ChunkChecksums* chunksChecksums, uint64_t chunksCount, const ChunkReference* references, uint64_t referencesCount,
+        uint32_t deltaBits, uint8_t* fat)
+    {
+        FatView view(fat, chunksCount, deltaBits, referencesCount);
+        uint8_t* deltas = const_cast<uint8_t*>(view.m_deltas);
+
+        for (uint64_t i = 0; i < chunksCount; i += CHECKPOINT_INTERVAL)
+        {
+            memcpy(fat + (i / CHECKPOINT_INTERVAL) * sizeof(uint64_t), &chunksOffsets[i], sizeof(uint64_t));
+        }
+        memcpy(fat + (checkpointsCount(chunksCount) - 1) * sizeof(uint64_t), &chunksOffsets[chunksCount], sizeof(uint64_t));
+
+        for (uint64_t i = 0; i < chunksCount; ++i)
+        {
+            uint64_t bitOffset = i * deltaBits;
+            uint64_t delta = chunksOffsets[i] - chunksOffsets[i - i % CHECKPOINT_INTERVAL];
+            uint64_t word;
+
+            memcpy(&word, deltas + bitOffset / 8, sizeof(word));
+            word |= delta << (bitOffset % 8);
+            memcpy(deltas + bitOffset / 8, &word, sizeof(word));
+        }
+
+        memcpy(const_cast<uint8_t*>(view.m_types), chunksTypes, chunksCount * sizeof(uint8_t));
+        memcpy(const_cast<uint8_t*>(view.m_parameters), chunksParameters, chunksCount * sizeof(uint8_t));
+        memcpy(const_cast<uint8_t*>(view.m_checksums), chunksChecksums, chunksCount * sizeof(ChunkChecksums));
+        memcpy(const_cast<uint8_t*>(view.m_references), references, referencesCount * sizeof(ChunkReference));
+    }
+
+    /* catches a file that isn't an archive, a newer version or a truncated file before anything gets parsed */
+    inline bool isValid(const ArchiveFooter& footer, uint64_t archiveSize)
+    {
+        const ArchiveHeader& header = footer.m_header;
+
+        return footer.m_magic == FOOTER_MAGIC
+            && header.m_magic == HEADER_MAGIC
+            && header.m_version == VERSION
+            && header.m_codec == CODEC_ZLIB
+            && (header.m_flags & ~KNOWN_FLAGS) == 0
+            && header.m_chunkSize != 0
+            && header.m_solidChunksCount != 0
+            && header.m_dictionarySize <= MAX_DICTIONARY_SIZE
+            && header.m_chunksCount == chunksCount(header.m_originalFileSize, header.m_chunkSize)
+            && footer.m_deltaBits <= MAX_DELTA_BITS
+            && footer.m_referencesCount <= header.m_chunksCount
+            && ((header.m_flags & FLAG_ASSET_INDEX) != 0) == (footer.m_indexSize != 0)
+            /// the file is the header and the chunks up to m_fatOffset, then the FAT, the index and the footer.
+            /// Each size is compared to what the ones after it leave of the file, their sum could wrap
+            && archiveSize >= sizeof(ArchiveFooter)
+            && footer.m_indexSize <= archiveSize - sizeof(ArchiveFooter)
+            && footer.m_fatSize <= archiveSize - sizeof(ArchiveFooter) - footer.m_indexSize
+            && footer.m_fatOffset == archiveSize - sizeof(ArchiveFooter) - footer.m_indexSize - footer.m_fatSize
+            && footer.m_fatOffset >= sizeof(ArchiveHeader) + header.m_dictionarySize
+            && isFatSize(footer.m_fatSize, header.m_chunksCount, footer.m_deltaBits, footer.m_referencesCount);
+    }
+}
@@ -0,0 +1,197 @@
+#include "pch.h"
+#include "AssetIndex.h"
+#include "MurmurHash3.h"
+
+/// about 4 names per bucket and 80% of the slots used keep the seeds search short
+static const size_t ASSETS_PER_BUCKET = 4;
+static const uint32_t MAX_BUCKET_SEED = 1 << 24;
+
+AssetIndex::AssetIndex()
+    : m_header()
+    , m_seeds(nullptr)
+    , m_slots(nullptr)
+    , m_entries(nullptr)
+    , m_names(nullptr)
+{
+}
+
+void AssetIndex::add(const std::wstring& name, size_t offset, size_t size)
+{
+    m_assets.push_back({ toName(name.c_str()), { offset, size } });
+}
+
+std::vector<uint8_t> AssetIndex::serialize() const
+{
+    ArchiveFormat::AssetIndexHeader header = {};
+    header.m_assetsCount = m_assets.size();
+    header.m_bucketsCount = std::max<size_t>(1, (m_assets.size() + ASSETS_PER_BUCKET - 1) / ASSETS_PER_BUCKET);
+    header.m_slotsCount = std::max<size_t>(1, m_assets.size() + m_assets.size() / 4);
+
+    /// group the assets by bucket
+    std::vector<std::vector<uint32_t>> buckets(static_cast<size_t>(header.m_bucketsCount));
+    for (uint32_t i = 0; i < m_assets.size(); ++i)
+    {
+        buckets[nameHash(m_assets[i].first, 0) % header.m_bucketsCount].push_back(i);
+    }
+
+    /// the fullest buckets first, while most slots are still free
+    std::vector<uint32_t> bucketsOrder(buckets.size());
+    for (uint32_t i = 0; i < buckets.size(); ++i)
+    {
+        bucketsOrder[i] = i;
+    }
+    std::stable_sort(bucketsOrder.begin(), bucketsOrder.end(), [&buckets](uint32_t a, uint32_t b)
+    {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<uint32_t> seeds(buckets.size(), 0);
+    std::vector<uint32_t> slots(static_cast<size_t>(header.m_slotsCount), ArchiveFormat::EMPTY_SLOT);
+    std::vector<size_t> bucketSlots;
+
+    for (uint32_t bucket : bucketsOrder)
+    {
+        if (buckets[bucket].empty())
+        {
+            break;
+        }
+
+        /// the first seed that sends every name of the bucket to a different free slot
+        for (uint32_t seed = 1;; ++seed)
+        {
+            /// two identical names never split up, a duplicated name ends up here
+            throwIfFalse(seed < MAX_BUCKET_SEED);
+
+            bucketSlots.clear();
+            for (uint32_t asset : buckets[bucket])
+            {
+                size_t slot = static_cast<size_t>(nameHash(m_assets[asset].first, seed) % header.m_slotsCount);
+
+                if (slots[slot] != ArchiveFormat::EMPTY_SLOT || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+                {
+                    break;
+                }
+
+                bucketSlots.push_back(slot);
+            }
+
+            if (bucketSlots.size() == buckets[bucket].size())
+            {
+                for (size_t i = 0; i < bucketSlots.size(); ++i)
+                {
+                    slots[bucketSlots[i]] = buckets[bucket][i];
+                }
+
+                seeds[bucket] = seed;
+                break;
+            }
+        }
+    }
+
+    std::vector<ArchiveFormat::AssetEntry> entries(m_assets.size());
+    Name names;
+
+    for (size_t i = 0; i < m_assets.size(); ++i)
+    {
+        entries[i].m_offset = m_assets[i].second.m_offset;
+        entries[i].m_size = m_assets[i].second.m_size;
+        entries[i].m_nameOffset = names.size();
+        entries[i].m_nameSize = static_cast<uint32_t>(m_assets[i].first.size());
+
+        names += m_assets[i].first;
+    }
+
+    header.m_namesSize = names.size();
+
+    std::vector<uint8_t> index;
+    auto append = [&index](const void* data, size_t size)
+    {
+        index.insert(index.end(), reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data) + size);
+    };
+
+    append(&header, sizeof(header));
+    append(seeds.data(), seeds.size() * sizeof(uint32_t));
+    append(slots.data(), slots.size() * sizeof(uint32_t));
+    append(entries.data(), entries.size() * sizeof(ArchiveFormat::AssetEntry));
+    append(names.data(), names.size() * sizeof(char16_t));
+
+    return index;
+}
+
+void AssetIndex::open(const uint8_t* data, size_t size)
+{
+    throwIfFalse(size >= sizeof(m_header));
+    memcpy(&m_header, data, sizeof(m_header));
+
+    /// every count is bounded by the index size before any multiplication can overflow
+    throwIfFalse(m_header.m_assetsCount <= size && m_header.m_bucketsCount <= size && m_header.m_slotsCount <= size && m_header.m_namesSize <= size);
+    throwIfFalse(m_header.m_bucketsCount != 0 && m_header.m_slotsCount != 0);
+    throwIfFalse(size == sizeof(m_header)
+        + (m_header.m_bucketsCount + m_header.m_slotsCount) * sizeof(uint32_t)
+        + m_header.m_assetsCount * sizeof(ArchiveFormat::AssetEntry)
+        + m_header.m_namesSize * sizeof(char16_t));
+
+    m_seeds = data + sizeof(m_header);
+    m_slots = m_seeds + m_header.m_bucketsCount * sizeof(uint32_t);
+    m_entries = m_slots + m_header.m_slotsCount * sizeof(uint32_t);
+    m_names = m_entries + m_header.m_assetsCount * sizeof(ArchiveFormat::AssetEntry);
+}
+
+bool AssetIndex::find(LPCWSTR name, Asset& asset) const
+{
+    if (!m_entries)
+    {
+        return false;
+    }
+
+    Name assetName = toName(name);
+
+    uint32_t seed;
+    memcpy(&seed, m_seeds + (nameHash(assetName, 0) % m_header.m_bucketsCount) * sizeof(uint32_t), sizeof(seed));
+
+    uint32_t slot;
+    memcpy(&slot, m_slots + (nameHash(assetName, seed) % m_header.m_slotsCount) * sizeof(uint32_t), sizeof(slot));
+
+    /// a perfect hash only knows the names it was built with, any other name still has to be compared
+    if (slot >= m_header.m_assetsCount)
+    {
+        return false;
+    }
+
+    ArchiveFormat::AssetEntry entry;
+    memcpy(&entry, m_entries + slot * sizeof(entry), sizeof(entry));
+
+    if (entry.m_nameSize != assetName.size()
+        || entry.m_nameOffset + entry.m_nameSize > m_header.m_namesSize
+        || memcmp(m_names + entry.m_nameOffset * sizeof(char16_t), assetName.data(), assetName.size() * sizeof(char16_t)) != 0)
+    {
+        return false;
+    }
+
+    asset.m_offset = static_cast<size_t>(entry.m_offset);
+    asset.m_size = static_cast<size_t>(entry.m_size);
+
+    return true;
+}
+
+size_t AssetIndex::assetsCount() const
+{
+    return static_cast<size_t>(m_header.m_assetsCount);
+}
+
+AssetIndex::Name AssetIndex::toName(LPCWSTR name)
+{
+    Name assetName;
+
+    for (; *name; ++name)
+    {
+        assetName.push_back(static_cast<char16_t>(*name));
+    }
+
+    return assetName;
+}
+
+uint64_t AssetIndex::nameHash(const Name& name, uint32_t seed)
+{
+    return MurmurHash3::hash128(name.data(), name.size() * sizeof(char16_t), seed).m_low;
+}
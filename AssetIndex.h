@@ -0,0 +1,50 @@
+#pragma once
+#include "pch.h"
+#include "ArchiveFormat.h"
+#include <string>
+
+/* Name to range index of the files of a pack. add and serialize build the index of a new pack, open reads
+   the index of an existing one in place. The names go through a hash and displace perfect hash, so finding
+   an asset is two hashes and a single name comparison whatever the number of assets. */
+class AssetIndex
+{
+public:
+    /* where an asset lies in the decompressed pack, it starts on a chunk boundary */
+    struct Asset
+    {
+        size_t m_offset;
+        size_t m_size;
+    };
+
+    AssetIndex();
+
+    void add(const std::wstring& name, size_t offset, size_t size);
+
+    /* the index as stored after the FAT, throws on a duplicated name */
+    std::vector<uint8_t> serialize() const;
+
+    /* validates and reads the index at data, which has to outlive the AssetIndex */
+    void open(const uint8_t* data, size_t size);
+
+    bool find(LPCWSTR name, Asset& asset) const;
+
+    size_t assetsCount() const;
+
+private:
+    /// asset names are stored and hashed as UTF-16 whatever wchar_t is
+    using Name = std::u16string;
+
+    static Name toName(LPCWSTR name);
+
+    static uint64_t nameHash(const Name& name, uint32_t seed);
+
+    /// assets of the index being built
+    std::vector<std::pair<Name, Asset>> m_assets;
+
+    /// index being read
+    ArchiveFormat::AssetIndexHeader m_header;
+    const uint8_t* m_seeds;
+    const uint8_t* m_slots;
+    const uint8_t* m_entries;
+    const uint8_t* m_names;
+};
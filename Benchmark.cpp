@@ -0,0 +1,337 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "ZStreamPool.h"
+#include "Compressor.h"
+#include "RangeReader.h"
+#include "Decompressor.h"
+#include "Parallelism.h"
+#include <random>
+#include <thread>
+#include <ppl.h>
+#include <string>
+
+namespace
+{
+    const size_t SMALL_CHUNK_SIZE = 4 * 1024;
+    const size_t SMALL_CHUNKS_COUNT = 20000;
+
+    const size_t SWEEP_MIN_CHUNK_SIZE = 16 * 1024;
+    const size_t RANDOM_READ_SIZE = 4 * 1024;
+    const size_t RANDOM_READS_COUNT = 1000;
+    const LPCWSTR SWEEP_ARCHIVE_PATH = L"DataPCSweep.forge";
+    const size_t MAX_SWEEP_SOLID_CHUNKS_COUNT = 256;
+    const size_t MAX_DICTIONARY_SWEEP_CHUNK_SIZE = 256 * 1024;
+    const LPCWSTR SCALING_OUTPUT_PATH = L"DataPCScaling.forge";
+    const size_t SEQUENTIAL_READ_SIZE = 1024 * 1024;
+    const size_t HOT_CHUNKS_COUNT = 300;
+    const size_t HOT_READS_COUNT = 20000;
+    const size_t CHUNK_CACHE_SIZE = 64 * 1024 * 1024;
+
+    /// a hot tier too small for the hot chunks, the warm tier holds the rest of them compressed
+    const size_t SMALL_CHUNK_CACHE_SIZE = 8 * 1024 * 1024;
+
+    /// structured test data like the one from Creation::createFile
+    std::vector<uint8_t> createCoordsData(size_t size)
+    {
+        std::vector<uint8_t> data(size);
+        uint32_t* coords = reinterpret_cast<uint32_t*>(data.data());
+
+        for (size_t i = 0; i < size / sizeof(uint32_t); ++i)
+        {
+            coords[i] = static_cast<uint32_t>(i);
+        }
+
+        return data;
+    }
+
+    double chunksPerSecond(size_t chunksCount, std::chrono::steady_clock::duration duration)
+    {
+        return chunksCount / std::chrono::duration<double>(duration).count();
+    }
+
+    void deflateChunk(z_stream& stream, const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destSize)
+    {
+        stream.next_in = const_cast<Bytef*>(source);
+        stream.avail_in = static_cast<uInt>(sourceSize);
+        stream.next_out = dest;
+        stream.avail_out = static_cast<uInt>(destSize);
+
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+        {
+            throw std::exception();
+        }
+    }
+
+    void inflateChunk(z_stream& stream, const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destSize)
+    {
+        stream.next_in = const_cast<Bytef*>(source);
+        stream.avail_in = static_cast<uInt>(sourceSize);
+        stream.next_out = dest;
+        stream.avail_out = static_cast<uInt>(destSize);
+
+        if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
+        {
+            throw std::exception();
+        }
+    }
+
+    /* compresses inputFilePath with compressor and prints the ratio, the compression speed and the random 4 KB read latency */
+    void sweepStep(Compressor& compressor, LPCWSTR inputFilePath, std::mt19937_64& random, const std::string& label)
+    {
+        size_t inputSize = fileSize(createReadFile(inputFilePath).get()).QuadPart;
+
+        auto t1 = std::chrono::steady_clock::now();
+        compressor.compress(inputFilePath, SWEEP_ARCHIVE_PATH);
+        auto t2 = std::chrono::steady_clock::now();
+
+        size_t archiveSize = fileSize(createReadFile(SWEEP_ARCHIVE_PATH).get()).QuadPart;
+
+        /// a fresh reader per step so the cached pages of the previous run don't help
+        std::vector<uint8_t> asset(RANDOM_READ_SIZE);
+        std::uniform_int_distribution<size_t> offsets(0, inputSize - std::min(inputSize, RANDOM_READ_SIZE));
+        RangeReader reader(SWEEP_ARCHIVE_PATH);
+
+        auto t3 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < RANDOM_READS_COUNT; ++i)
+        {
+            reader.read(offsets(random), asset.data(), asset.size());
+        }
+        auto t4 = std::chrono::steady_clock::now();
+
+        std::cout << label << ", ratio: " << static_cast<double>(inputSize) / archiveSize
+            << ", compression: " << inputSize / (1024.0 * 1024.0) / std::chrono::duration<double>(t2 - t1).count() << " MB/s"
+            << ", random " << RANDOM_READ_SIZE / 1024 << " KB read: "
+            << std::chrono::duration<double, std::micro>(t4 - t3).count() / RANDOM_READS_COUNT << " us" << std::endl;
+    }
+}
+
+void Benchmark::streamPool()
+{
+    std::vector<uint8_t> input = createCoordsData(SMALL_CHUNK_SIZE);
+    std::vector<uint8_t> compressed(compressBound(SMALL_CHUNK_SIZE));
+    std::vector<uint8_t> decompressed(SMALL_CHUNK_SIZE);
+    size_t compressedSize = 0;
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SMALL_CHUNKS_COUNT; ++i)
+    {
+        z_stream stream = {};
+        throwIfFailed(deflateInit(&stream, COMPRESSION_LEVEL));
+        deflateChunk(stream, input.data(), input.size(), compressed.data(), compressed.size());
+        compressedSize = stream.total_out;
+        (void)deflateEnd(&stream);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SMALL_CHUNKS_COUNT; ++i)
+    {
+        auto stream = ZStreamPool::acquireDeflate(COMPRESSION_LEVEL);
+        deflateChunk(stream->m_stream, input.data(), input.size(), compressed.data(), compressed.size());
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    std::cout << "deflate " << SMALL_CHUNK_SIZE / 1024 << " KB chunks, fresh streams: " << chunksPerSecond(SMALL_CHUNKS_COUNT, t2 - t1)
+        << " chunks/s, pooled streams: " << chunksPerSecond(SMALL_CHUNKS_COUNT, t3 - t2) << " chunks/s" << std::endl;
+
+    t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SMALL_CHUNKS_COUNT; ++i)
+    {
+        z_stream stream = {};
+        throwIfFailed(inflateInit(&stream));
+        inflateChunk(stream, compressed.data(), compressedSize, decompressed.data(), decompressed.size());
+        (void)inflateEnd(&stream);
+    }
+    t2 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SMALL_CHUNKS_COUNT; ++i)
+    {
+        auto stream = ZStreamPool::acquireInflate();
+        inflateChunk(stream->m_stream, compressed.data(), compressedSize, decompressed.data(), decompressed.size());
+    }
+    t3 = std::chrono::steady_clock::now();
+
+    std::cout << "inflate " << SMALL_CHUNK_SIZE / 1024 << " KB chunks, fresh streams: " << chunksPerSecond(SMALL_CHUNKS_COUNT, t2 - t1)
+        << " chunks/s, pooled streams: " << chunksPerSecond(SMALL_CHUNKS_COUNT, t3 - t2) << " chunks/s" << std::endl;
+}
+
+void Benchmark::chunkSizeSweep(LPCWSTR inputFilePath)
+{
+    std::mt19937_64 random(42);
+
+    for (size_t chunkSize = SWEEP_MIN_CHUNK_SIZE; chunkSize <= MAX_CHUNK_SIZE; chunkSize *= 2)
+    {
+        Compressor compressor(chunkSize);
+        sweepStep(compressor, inputFilePath, random, std::to_string(chunkSize / 1024) + " KB chunks");
+    }
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+}
+
+void Benchmark::solidGroupSweep(LPCWSTR inputFilePath)
+{
+    std::mt19937_64 random(42);
+
+    for (size_t solidChunksCount = 1; solidChunksCount <= MAX_SWEEP_SOLID_CHUNKS_COUNT; solidChunksCount *= 2)
+    {
+        Compressor compressor(PAGE_SIZE, solidChunksCount);
+        sweepStep(compressor, inputFilePath, random, std::to_string(solidChunksCount) + " chunks per solid group");
+    }
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+}
+
+void Benchmark::dictionarySweep(LPCWSTR inputFilePath)
+{
+    std::mt19937_64 random(42);
+
+    for (size_t chunkSize = MIN_CHUNK_SIZE; chunkSize <= MAX_DICTIONARY_SWEEP_CHUNK_SIZE; chunkSize *= 2)
+    {
+        for (size_t dictionarySize : { size_t(0), size_t(ArchiveFormat::MAX_DICTIONARY_SIZE) })
+        {
+            Compressor compressor(chunkSize, 1, dictionarySize);
+            sweepStep(compressor, inputFilePath, random,
+                std::to_string(chunkSize / 1024) + " KB chunks, " + std::to_string(dictionarySize / 1024) + " KB dictionary");
+        }
+    }
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+}
+
+void Benchmark::coreScaling(LPCWSTR inputFilePath)
+{
+    const size_t coresCount = std::max(1u, std::thread::hardware_concurrency());
+    const double inputMegabytes = fileSize(createReadFile(inputFilePath).get()).QuadPart / (1024.0 * 1024.0);
+
+    std::vector<size_t> workersCounts;
+    for (size_t workersCount = 1; workersCount < coresCount; workersCount *= 2)
+    {
+        workersCounts.push_back(workersCount);
+    }
+    workersCounts.push_back(coresCount);
+
+    double compressionBase = 0;
+    double decompressionBase = 0;
+
+    for (size_t workersCount : workersCounts)
+    {
+        /// the compression workers are our threads, the decompression batches run on a scheduler limited the same way
+        Parallelism::setWorkersCount(workersCount);
+        concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(2,
+            concurrency::MinConcurrency, 1, concurrency::MaxConcurrency, static_cast<unsigned int>(workersCount)));
+
+        auto t1 = std::chrono::steady_clock::now();
+        Compressor().compress(inputFilePath, SWEEP_ARCHIVE_PATH);
+        auto t2 = std::chrono::steady_clock::now();
+        Decompressor().decompress(SWEEP_ARCHIVE_PATH, SCALING_OUTPUT_PATH);
+        auto t3 = std::chrono::steady_clock::now();
+
+        concurrency::CurrentScheduler::Detach();
+
+        double compression = inputMegabytes / std::chrono::duration<double>(t2 - t1).count();
+        double decompression = inputMegabytes / std::chrono::duration<double>(t3 - t2).count();
+
+        if (workersCount == 1)
+        {
+            compressionBase = compression;
+            decompressionBase = decompression;
+        }
+
+        std::cout << workersCount << " cores, " << Parallelism::batchChunksCount(PAGE_SIZE, 1) << " chunks per batch"
+            << ", compression: " << compression << " MB/s (x" << compression / compressionBase << ")"
+            << ", decompression: " << decompression << " MB/s (x" << decompression / decompressionBase << ")" << std::endl;
+    }
+
+    Parallelism::setWorkersCount(0);
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+    DeleteFile(SCALING_OUTPUT_PATH);
+}
+
+void Benchmark::archiveMapping(LPCWSTR inputFilePath)
+{
+    Compressor().compress(inputFilePath, SWEEP_ARCHIVE_PATH);
+
+    for (CompressedFileMap::Mode mode : { CompressedFileMap::Mode::Mapped, CompressedFileMap::Mode::PageCache })
+    {
+        std::mt19937_64 random(42);
+        RangeReader reader(SWEEP_ARCHIVE_PATH, mode);
+
+        const size_t inputSize = reader.fileSize();
+        std::uniform_int_distribution<size_t> offsets(0, inputSize - std::min(inputSize, RANDOM_READ_SIZE));
+        std::vector<uint8_t> buffer(SEQUENTIAL_READ_SIZE);
+
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < RANDOM_READS_COUNT; ++i)
+        {
+            reader.read(offsets(random), buffer.data(), RANDOM_READ_SIZE);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < inputSize; offset += SEQUENTIAL_READ_SIZE)
+        {
+            reader.read(offset, buffer.data(), SEQUENTIAL_READ_SIZE);
+        }
+        auto t3 = std::chrono::steady_clock::now();
+
+        std::cout << (mode == CompressedFileMap::Mode::Mapped ? "mapped archive" : "page cache")
+            << ", random " << RANDOM_READ_SIZE / 1024 << " KB read: "
+            << std::chrono::duration<double, std::micro>(t2 - t1).count() / RANDOM_READS_COUNT << " us"
+            << ", sequential read: " << inputSize / (1024.0 * 1024.0) / std::chrono::duration<double>(t3 - t2).count() << " MB/s" << std::endl;
+    }
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+}
+
+void Benchmark::chunkCache(LPCWSTR inputFilePath)
+{
+    Compressor().compress(inputFilePath, SWEEP_ARCHIVE_PATH);
+
+    const std::pair<size_t, size_t> cacheSizes[] =
+    {
+        { 0, 0 },
+        { CHUNK_CACHE_SIZE, 0 },
+        { SMALL_CHUNK_CACHE_SIZE, 0 },
+        { SMALL_CHUNK_CACHE_SIZE, CHUNK_CACHE_SIZE },
+    };
+
+    for (auto& cacheSize : cacheSizes)
+    {
+        std::mt19937_64 random(42);
+        /// a warm hit still inflates, it only saves reading the archive. When the page cache holds the whole archive
+        /// that is a lookup, and the warm rows time about the same as the ones without, the difference is in the I/O
+        RangeReader reader(SWEEP_ARCHIVE_PATH, CompressedFileMap::Mode::PageCache, cacheSize.first, cacheSize.second);
+
+        const size_t chunksCount = (reader.fileSize() + PAGE_SIZE - 1) / PAGE_SIZE;
+        std::uniform_int_distribution<size_t> chunks(0, chunksCount - 1);
+        std::uniform_int_distribution<size_t> hotChunks(0, HOT_CHUNKS_COUNT - 1);
+
+        std::vector<size_t> hotChunkIndices(HOT_CHUNKS_COUNT);
+        for (size_t& hotChunkIndex : hotChunkIndices)
+        {
+            hotChunkIndex = chunks(random);
+        }
+
+        std::vector<uint8_t> asset(RANDOM_READ_SIZE);
+
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < HOT_READS_COUNT; ++i)
+        {
+            reader.read(hotChunkIndices[hotChunks(random)] * PAGE_SIZE, asset.data(), asset.size());
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::cout << cacheSize.first / (1024 * 1024) << " MB hot, " << cacheSize.second / (1024 * 1024) << " MB warm"
+            << ", hot " << RANDOM_READ_SIZE / 1024 << " KB read: "
+            << std::chrono::duration<double, std::micro>(t2 - t1).count() / HOT_READS_COUNT << " us";
+
+        if (const TieredChunkCache* chunkCache = reader.chunkCache())
+        {
+            TieredChunkCache::Statistics statistics = chunkCache->statistics();
+            std::cout << ", hot tier " << statistics.m_hot.m_hitsCount << " hits, " << statistics.m_hot.m_missesCount << " misses, "
+                << statistics.m_hot.m_cachedBytes / (1024 * 1024) << " MB cached"
+                << ", warm tier " << statistics.m_warm.m_hitsCount << " hits, " << statistics.m_warm.m_missesCount << " misses, "
+                << statistics.m_warm.m_cachedBytes / (1024 * 1024) << " MB cached";
+        }
+
+        std::cout << std::endl;
+    }
+
+    DeleteFile(SWEEP_ARCHIVE_PATH);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+
+namespace Benchmark
+{
+    /* chunks per second of deflating and inflating small chunks with a fresh z_stream per chunk against the pooled streams */
+    void streamPool();
+
+    /* compression ratio, compression speed and random 4 KB read latency of inputFilePath for chunk sizes from 16 KB to 4 MB */
+    void chunkSizeSweep(LPCWSTR inputFilePath);
+
+    /* the same for 64 KB chunks in solid groups from 1 to 256 chunks, the ratio against the seek cost */
+    void solidGroupSweep(LPCWSTR inputFilePath);
+
+    /* the same for chunks from 4 KB to 256 KB, without and with a trained 32 KB dictionary */
+    void dictionarySweep(LPCWSTR inputFilePath);
+
+    /* compression and decompression speed of inputFilePath on 1, 2, 4... cores up to all of them */
+    void coreScaling(LPCWSTR inputFilePath);
+
+    /* random 4 KB reads and a sequential read of the whole file through the mapped archive against the page cache */
+    void archiveMapping(LPCWSTR inputFilePath);
+
+    /* random 4 KB reads of a few hundred hot chunks without and with the cache of decompressed chunks */
+    void chunkCache(LPCWSTR inputFilePath);
+}
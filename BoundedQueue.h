@@ -0,0 +1,68 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+/* Blocking FIFO with a fixed capacity, used to connect the stages of the compression pipeline */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /* blocks while the queue is full, returns false if the queue got closed */
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_items.size() < m_capacity || m_closed; });
+
+        if (m_closed)
+        {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+
+        return true;
+    }
+
+    /* blocks while the queue is empty, returns false once the queue is closed and drained */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+
+        if (m_items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+
+        return true;
+    }
+
+    /* no more pushes, the consumers drain what is left */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+};
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "ChunkCache.h"
+
+static const size_t SHARDS_COUNT = 16;
+
+ChunkCache::ChunkCache(size_t budget)
+    : m_shardBudget(budget / SHARDS_COUNT)
+    , m_shards(SHARDS_COUNT)
+    , m_hitsCount(0)
+    , m_missesCount(0)
+{
+}
+
+ChunkCache::Handle ChunkCache::find(size_t chunkIndex)
+{
+    Shard& shard = shardOf(chunkIndex);
+
+    {
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        auto entry = shard.m_entries.find(chunkIndex);
+
+        if (entry != shard.m_entries.end())
+        {
+            shard.m_order.splice(shard.m_order.begin(), shard.m_order, entry->second.m_position);
+            ++m_hitsCount;
+
+            return entry->second.m_handle;
+        }
+    }
+
+    ++m_missesCount;
+    return nullptr;
+}
+
+ChunkCache::Handle ChunkCache::insert(size_t chunkIndex, Handle chunk, size_t size, std::vector<size_t>* evictedChunks)
+{
+    /// a chunk bigger than the whole shard is handed out without being cached
+    if (size > m_shardBudget)
+    {
+        return chunk;
+    }
+
+    Shard& shard = shardOf(chunkIndex);
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    auto entry = shard.m_entries.find(chunkIndex);
+
+    if (entry != shard.m_entries.end())
+    {
+        return entry->second.m_handle;
+    }
+
+    while (shard.m_cachedBytes + size > m_shardBudget)
+    {
+        auto leastRecentlyUsed = shard.m_entries.find(shard.m_order.back());
+
+        if (evictedChunks)
+        {
+            evictedChunks->push_back(leastRecentlyUsed->first);
+        }
+
+        shard.m_cachedBytes -= leastRecentlyUsed->second.m_size;
+        shard.m_entries.erase(leastRecentlyUsed);
+        shard.m_order.pop_back();
+    }
+
+    shard.m_order.push_front(chunkIndex);
+    shard.m_entries.emplace(chunkIndex, Entry{ chunk, size, shard.m_order.begin() });
+    shard.m_cachedBytes += size;
+
+    return chunk;
+}
+
+bool ChunkCache::touch(size_t chunkIndex)
+{
+    Shard& shard = shardOf(chunkIndex);
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    auto entry = shard.m_entries.find(chunkIndex);
+
+    if (entry == shard.m_entries.end())
+    {
+        return false;
+    }
+
+    shard.m_order.splice(shard.m_order.begin(), shard.m_order, entry->second.m_position);
+    return true;
+}
+
+ChunkCache::Statistics ChunkCache::statistics() const
+{
+    Statistics statistics = { m_hitsCount, m_missesCount, 0 };
+
+    for (const Shard& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        statistics.m_cachedBytes += shard.m_cachedBytes;
+    }
+
+    return statistics;
+}
+
+ChunkCache::Shard& ChunkCache::shardOf(size_t chunkIndex)
+{
+    return m_shards[chunkIndex % SHARDS_COUNT];
+}
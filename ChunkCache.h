@@ -0,0 +1,71 @@
+#pragma once
+#include "pch.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/* Chunks kept for the next reads of the same chunks, decompressed so a hot asset is inflated once, or compressed
+   as the warm tier of TieredChunkCache. The cache holds at most a byte budget of chunks split over SHARDS_COUNT
+   shards by chunk index, each with its own lock and its own least recently used order, so readers of different
+   chunks rarely wait on each other.
+   find and insert hand out a Handle that keeps its chunk alive, an evicted chunk goes once its last handle is gone. */
+class ChunkCache
+{
+public:
+    /* the decompressed bytes of a chunk, valid for as long as the handle lives */
+    using Handle = std::shared_ptr<const uint8_t>;
+
+    struct Statistics
+    {
+        size_t m_hitsCount;
+        size_t m_missesCount;
+        size_t m_cachedBytes;
+    };
+
+    /* budget bytes of decompressed chunks at most */
+    explicit ChunkCache(size_t budget);
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    /* the cached chunk chunkIndex, nullptr if it isn't cached. Counts a hit or a miss */
+    Handle find(size_t chunkIndex);
+
+    /* caches size bytes of chunk chunkIndex and returns its handle, the one already cached if another reader got
+       there first. The chunks it evicts to make room are added to evictedChunks if given */
+    Handle insert(size_t chunkIndex, Handle chunk, size_t size, std::vector<size_t>* evictedChunks = nullptr);
+
+    /* makes the chunk the most recently used one without counting a hit or a miss, returns whether it is cached */
+    bool touch(size_t chunkIndex);
+
+    Statistics statistics() const;
+
+private:
+    struct Entry
+    {
+        Handle m_handle;
+        size_t m_size;
+        std::list<size_t>::iterator m_position;
+    };
+
+    struct Shard
+    {
+        Shard() : m_cachedBytes(0) {}
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<size_t, Entry> m_entries;
+
+        /// most recently used chunks first
+        std::list<size_t> m_order;
+        size_t m_cachedBytes;
+    };
+
+    Shard& shardOf(size_t chunkIndex);
+
+    const size_t m_shardBudget;
+    std::vector<Shard> m_shards;
+
+    std::atomic<size_t> m_hitsCount;
+    std::atomic<size_t> m_missesCount;
+};
@@ -1,59 +1,166 @@
 #include "pch.h"
 #include "CompressedFileMap.h"
 
-static const size_t PAGE_COUNT = 5;
+static const size_t SHARDS_COUNT = 4;
+static const size_t PAGES_PER_SHARD_COUNT = 4;
 static const size_t PAGE_CACHE_SIZE = 64 * 1024 * 100;
 
-CompressedFileMap::CompressedFileMap(LPCWSTR compressedFileName)
-    : m_pages(PAGE_COUNT), m_fileName(compressedFileName), m_nextNewPageIndex(0)
+/// a page also holds the start of the next block, so a read crossing the block end still hits
+static const size_t PAGE_OVERLAP_SIZE = 64 * 1024 * 16;
+
+static_assert(PAGE_CACHE_SIZE % ALLOCATION_GRANULARITY == 0, "a page starts on a view boundary");
+
+CompressedFileMap::CompressedFileMap(LPCWSTR compressedFileName, Mode mode)
+    : m_mode(mode)
+    , m_file(createReadFile(compressedFileName))
+    , m_fileMapping(createReadFileMapping(m_file.get(), 0))
+    , m_fileSize(fileSize(m_file.get()).QuadPart)
 {
+    if (m_mode == Mode::Mapped)
+    {
+        LARGE_INTEGER viewOffset;
+        viewOffset.QuadPart = 0;
+        m_fileView = createReadMapViewOfFile(m_fileMapping.get(), viewOffset, m_fileSize);
+        return;
+    }
+
+    m_shards = std::vector<Shard>(SHARDS_COUNT);
+
+    for (Shard& shard : m_shards)
+    {
+        shard.m_slots.resize(PAGES_PER_SHARD_COUNT);
+    }
 }
 
-void* CompressedFileMap::readMem(size_t start, size_t size)
+CompressedFileMap::View CompressedFileMap::readMem(size_t start, size_t size)
 {
-    /// find in current pages if found
-    for (size_t i = 0; i < PAGE_COUNT; ++i)
+    throwIfFalse(start + size <= m_fileSize);
+
+    if (m_mode == Mode::Mapped)
+    {
+        /// the view shares the ownership of the whole mapping, it stays valid even past the map
+        return View(m_fileView, reinterpret_cast<uint8_t*>(m_fileView.get()) + start);
+    }
+
+    const size_t pageBlock = start / PAGE_CACHE_SIZE;
+    Shard& shard = m_shards[pageBlock % SHARDS_COUNT];
+
+    /// a view keeps the page alive on its own, the aliasing pointer points into the page
+    auto viewOf = [start](const std::shared_ptr<Page>& page)
+    {
+        return View(page, reinterpret_cast<uint8_t*>(page->m_buffer.get()) + (start - page->m_start));
+    };
+
     {
-        if (m_pages[i].m_start.QuadPart <= start && start + size <= m_pages[i].m_end.QuadPart)
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+        for (Slot& slot : shard.m_slots)
         {
-            uint8_t* buffer = reinterpret_cast<uint8_t*>(m_pages[i].m_buffer.get());
-            size_t offset = start - m_pages[i].m_start.QuadPart;
+            if (slot.m_page && slot.m_page->m_start == pageBlock * PAGE_CACHE_SIZE && start + size <= slot.m_page->m_end)
+            {
+                slot.m_isReferenced = true;
+                return viewOf(slot.m_page);
+            }
+        }
+    }
 
-            return buffer + offset;
+    /// copy the page without holding the shard, another thread may load the same one meanwhile, the last one stays
+    std::shared_ptr<Page> page = loadPage(start, size);
+
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    /// a page of the same block that is too short for this read is replaced, its readers keep their views
+    Slot* pageSlot = nullptr;
+
+    for (Slot& slot : shard.m_slots)
+    {
+        if (slot.m_page && slot.m_page->m_start == page->m_start)
+        {
+            pageSlot = &slot;
         }
     }
 
-    /// map the page that contains start
-    ManagedHandle fileHandle = createReadFile(m_fileName);
-    ManagedHandle fileMapping = createReadFileMapping(fileHandle.get(), 0);
+    if (!pageSlot)
+    {
+        pageSlot = &replacementSlot(shard);
+    }
+
+    pageSlot->m_page = page;
+    pageSlot->m_isReferenced = true;
 
-    size_t alignedStart = alignDown(start, 65536);
-    size_t viewSize = getCorrectViewSize(fileHandle.get(), alignedStart, PAGE_CACHE_SIZE);
+    return viewOf(page);
+}
 
-    ManagedViewHandle fileView = createReadMapViewOfFile(fileMapping.get(), { (DWORD)alignedStart }, viewSize);
+void CompressedFileMap::prefetch(size_t start, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
 
-    std::unique_ptr<uint8_t[]> newPage(reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, viewSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE)));
-    memcpy(newPage.get(), fileView.get(), viewSize);
+    if (m_mode == Mode::PageCache)
+    {
+        /// one block at a time, a page stretched to the end of a long range would be copied again by the next prefetch.
+        /// The page stays in the cache once the view is gone
+        for (size_t blockStart = alignDown(start, PAGE_CACHE_SIZE); blockStart < start + size; blockStart += PAGE_CACHE_SIZE)
+        {
+            size_t partStart = std::max(start, blockStart);
+            readMem(partStart, std::min(start + size, blockStart + PAGE_CACHE_SIZE) - partStart);
+        }
 
-    void* result = newPage.get() + (start - alignedStart);
+        return;
+    }
 
-    m_pages[m_nextNewPageIndex].m_buffer = ManagedMem(newPage.release(), MemoryHandle());
-    m_pages[m_nextNewPageIndex].m_start.QuadPart = alignedStart;
-    m_pages[m_nextNewPageIndex].m_end.QuadPart = alignedStart + viewSize;
+    throwIfFalse(start + size <= m_fileSize);
 
-    m_nextNewPageIndex = (m_nextNewPageIndex + 1) % PAGE_COUNT;
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = reinterpret_cast<uint8_t*>(m_fileView.get()) + start;
+    range.NumberOfBytes = size;
 
-    return result;
+    /// only a hint, reading without it is just slower
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
 }
 
-size_t CompressedFileMap::getCorrectViewSize(HANDLE file, size_t start, size_t viewSize)
+std::shared_ptr<CompressedFileMap::Page> CompressedFileMap::loadPage(size_t start, size_t size) const
 {
-    size_t sizeOfFile = fileSize(file).QuadPart;
+    auto page = std::make_shared<Page>();
+    page->m_start = alignDown(start, PAGE_CACHE_SIZE);
+
+    /// big chunks can ask for more than a page, the page grows to fit the request, and the last one stops at the end of file
+    page->m_end = std::min(std::max(page->m_start + PAGE_CACHE_SIZE + PAGE_OVERLAP_SIZE, start + size), m_fileSize);
+
+    const size_t viewSize = page->m_end - page->m_start;
 
-    if (start + viewSize >= sizeOfFile)
+    LARGE_INTEGER viewOffset;
+    viewOffset.QuadPart = page->m_start;
+    ManagedViewHandle fileView = createReadMapViewOfFile(m_fileMapping.get(), viewOffset, viewSize);
+
+    page->m_buffer = ManagedMem(VirtualAlloc(nullptr, viewSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE), MemoryHandle());
+    throwIfFalse(page->m_buffer != nullptr);
+
+    memcpy(page->m_buffer.get(), fileView.get(), viewSize);
+
+    return page;
+}
+
+CompressedFileMap::Slot& CompressedFileMap::replacementSlot(Shard& shard)
+{
+    /// a pinned page is passed over like a referenced one, but after two full turns the hand takes whatever it is on
+    for (size_t step = 0; step < 2 * shard.m_slots.size(); ++step)
     {
-        viewSize = sizeOfFile - start;
+        Slot& slot = shard.m_slots[shard.m_hand];
+
+        if (!slot.m_page || (!slot.m_isReferenced && slot.m_page.use_count() == 1))
+        {
+            break;
+        }
+
+        slot.m_isReferenced = false;
+        shard.m_hand = (shard.m_hand + 1) % shard.m_slots.size();
     }
 
-    return viewSize;
+    Slot& slot = shard.m_slots[shard.m_hand];
+    shard.m_hand = (shard.m_hand + 1) % shard.m_slots.size();
+
+    return slot;
 }
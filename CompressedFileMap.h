@@ -1,6 +1,16 @@
 #pragma once
 #include "pch.h"
+#include <mutex>
 
+/* The compressed archive as seen by the threads that decompress from it, in one of two modes.
+   Mapped maps the whole archive once for the lifetime of the map, readMem only points into it and prefetch asks
+   the system to read ahead the parts the FAT says come next, without any copy of our own.
+   Prefetch in PageCache mode loads the pages right away, it is meant for a background thread like the Prefetcher.
+   PageCache keeps pages copied out of the file, for when the address space can't take the whole archive. A page
+   is found by the PAGE_CACHE_SIZE block its start falls in, so the pages are split over SHARDS_COUNT shards with a
+   lock each and concurrent readers of different parts of the archive don't wait on each other. Each shard
+   replaces its pages with CLOCK, a page read since the hand last passed gets a second chance.
+   readMem hands out a View that pins its page, an evicted page stays alive until its last view is gone. */
 class CompressedFileMap
 {
     struct MemoryHandle
@@ -13,26 +23,66 @@ class CompressedFileMap
 
     using ManagedMem = std::unique_ptr<void, MemoryHandle>;
 
+    /* a copy of the archive from m_start to m_end */
     struct Page
     {
-        Page() : m_start({0}), m_end({0}), m_buffer(nullptr) {}
+        Page() : m_start(0), m_end(0), m_buffer(nullptr) {}
 
-        LARGE_INTEGER m_start;
-        LARGE_INTEGER m_end;
+        size_t m_start;
+        size_t m_end;
         ManagedMem m_buffer;
     };
 
+    /* a place for a page in a shard, m_isReferenced is the CLOCK bit */
+    struct Slot
+    {
+        Slot() : m_isReferenced(false) {}
+
+        std::shared_ptr<Page> m_page;
+        bool m_isReferenced;
+    };
+
+    struct Shard
+    {
+        Shard() : m_hand(0) {}
+
+        std::mutex m_mutex;
+        std::vector<Slot> m_slots;
+        size_t m_hand;
+    };
+
 public:
-    CompressedFileMap(LPCWSTR compressedFileName);
+    enum class Mode
+    {
+        Mapped,
+        PageCache,
+    };
+
+    /* size bytes of the archive, pinned in memory for as long as the view lives */
+    using View = std::shared_ptr<uint8_t>;
+
+    CompressedFileMap(LPCWSTR compressedFileName, Mode mode = Mode::Mapped);
+
+    /* the archive from start to start + size, safe to call from any thread */
+    View readMem(size_t start, size_t size);
 
-    void* readMem(size_t start, size_t size);
+    /* the archive from start to start + size will be read soon, Mapped only hints it and PageCache loads its page */
+    void prefetch(size_t start, size_t size);
 
 private:
-    /* assure that we don't read past the end of file */
-    size_t getCorrectViewSize(HANDLE file, size_t start, size_t size);
+    /* copies the archive from the page block of start up to at least start + size into a new page */
+    std::shared_ptr<Page> loadPage(size_t start, size_t size) const;
 
-    std::vector<Page> m_pages;
-    LPCWSTR m_fileName;
-    size_t m_nextNewPageIndex;
-};
+    /* the slot of the shard the next page goes in, an empty one or the one CLOCK evicts. The shard is locked */
+    Slot& replacementSlot(Shard& shard);
+
+    Mode m_mode;
+    ManagedHandle m_file;
+    ManagedHandle m_fileMapping;
+    size_t m_fileSize;
 
+    /// the whole archive in Mapped mode
+    std::shared_ptr<void> m_fileView;
+
+    std::vector<Shard> m_shards;
+};
@@ -1,201 +1,547 @@
 #include "pch.h"
 #include "Fat.h"
 #include "Compressor.h"
-#include <ppl.h>
+#include "ZStreamPool.h"
+#include "Parallelism.h"
+#include "Crc32c.h"
+#include "MurmurHash3.h"
+#include "AssetIndex.h"
+#include "DictionaryTrainer.h"
+#include "DeflateStrategy.h"
+#include <emmintrin.h>
+
+namespace
+{
+    /// how much of the input the dictionary is trained on, spread over the whole input
+    const size_t DICTIONARY_SAMPLES_SIZE = 8 * 1024 * 1024;
+
+    /* whether every byte of data is data[0], compares 64 bytes per iteration with SSE2 */
+    bool isConstant(const uint8_t* data, size_t size)
+    {
+        const __m128i fill = _mm_set1_epi8(static_cast<char>(data[0]));
+        size_t i = 0;
+
+        for (; i + 64 <= size; i += 64)
+        {
+            const __m128i* block = reinterpret_cast<const __m128i*>(data + i);
+
+            __m128i equal = _mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(block), fill), _mm_cmpeq_epi8(_mm_loadu_si128(block + 1), fill)),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(block + 2), fill), _mm_cmpeq_epi8(_mm_loadu_si128(block + 3), fill)));
+
+            if (_mm_movemask_epi8(equal) != 0xFFFF)
+            {
+                return false;
+            }
+        }
+
+        for (; i < size; ++i)
+        {
+            if (data[i] != data[0])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* the files under directory, recursively, as paths relative to it */
+    void listFiles(const std::wstring& directory, const std::wstring& relativeDirectory, std::vector<std::wstring>& relativePaths)
+    {
+        WIN32_FIND_DATA findData;
+        HANDLE find = FindFirstFile((directory + L"/" + relativeDirectory + L"*").c_str(), &findData);
 
-Compressor::Compressor()
+        if (find == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        do
+        {
+            std::wstring name = findData.cFileName;
+
+            if (name == L"." || name == L"..")
+            {
+                continue;
+            }
+
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                listFiles(directory, relativeDirectory + name + L"/", relativePaths);
+            }
+            else
+            {
+                relativePaths.push_back(relativeDirectory + name);
+            }
+        } while (FindNextFile(find, &findData));
+
+        FindClose(find);
+    }
+}
+
+Compressor::Compressor(size_t chunkSize, size_t solidChunksCount, size_t dictionarySize)
+    : m_chunkSize(chunkSize)
+    , m_solidChunksCount(solidChunksCount)
+    , m_dictionarySize(dictionarySize)
 {
+    /// the input windows have to split evenly into chunks
+    throwIfFalse(chunkSize >= MIN_CHUNK_SIZE && chunkSize <= MAX_CHUNK_SIZE && isAligned(INPUT_WINDOW_SIZE, chunkSize));
+    throwIfFalse(solidChunksCount != 0 && solidChunksCount <= UINT32_MAX);
+    throwIfFalse(dictionarySize <= ArchiveFormat::MAX_DICTIONARY_SIZE);
 }
 
 void Compressor::compress(LPCWSTR inputFilePath, LPCWSTR outputFilePath)
 {
-    /// open input file
-    ManagedHandle bigFile = createReadFile(inputFilePath);
-    ManagedHandle fileMapping = createReadFileMapping(bigFile.get(), 0);
+    /// contains offsets of the compressed chunks
+    Fat fat;
+    compressFiles({ inputFilePath }, outputFilePath, fat);
+}
 
-    /// align down file size to map size
-    LARGE_INTEGER bigFileSize = fileSize(bigFile.get());
-    LARGE_INTEGER bigFileAlignedSize = alignDown(bigFileSize, MAP_SIZE);
+void Compressor::setThroughputController(std::unique_ptr<ThroughputController> controller)
+{
+    m_throughputController = std::move(controller);
+}
 
-    /// how much map viewing we have to do
-    const size_t MAP_COUNT = bigFileAlignedSize.QuadPart / MAP_SIZE;
+const ThroughputController* Compressor::throughputController() const
+{
+    return m_throughputController.get();
+}
 
-    /// contains offsets of the compressed chunks
-    Fat fat;
+void Compressor::compressDirectory(LPCWSTR inputDirectoryPath, LPCWSTR outputFilePath)
+{
+    std::vector<std::wstring> assetNames;
+    listFiles(inputDirectoryPath, L"", assetNames);
+
+    /// the same directory always gives the same pack
+    std::sort(assetNames.begin(), assetNames.end());
 
-    for (size_t i = 0; i < MAP_COUNT; ++i)
+    AssetIndex assetIndex;
+    std::vector<std::wstring> inputFilePaths;
+    size_t assetOffset = 0;
+
+    for (const std::wstring& assetName : assetNames)
     {
-        /// the offset to the current map view of the file
-        LARGE_INTEGER offset;
-        offset.QuadPart = i * MAP_SIZE;
+        inputFilePaths.push_back(std::wstring(inputDirectoryPath) + L"/" + assetName);
 
-        ManagedViewHandle mapFile = createReadMapViewOfFile(fileMapping.get(), offset, MAP_SIZE);
+        size_t assetSize = fileSize(createReadFile(inputFilePaths.back().c_str()).get()).QuadPart;
+        assetIndex.add(assetName, assetOffset, assetSize);
 
-        auto chunks = splitFile(reinterpret_cast<uint8_t*>(mapFile.get()), CHUNKS_PER_MAP_COUNT, PAGE_SIZE);
-        auto compressedChunks = compressChunks(std::move(chunks));
-        writeCompressedChunksToFile(std::move(compressedChunks), outputFilePath);
-        getFat(fat, std::move(compressedChunks));
+        assetOffset = align(assetOffset + assetSize, m_chunkSize);
     }
 
-    /// now we compress the remaining unaligned datas
-    size_t remainingDataInByte = bigFileSize.QuadPart - bigFileAlignedSize.QuadPart;
+    Fat fat;
+    fat.setAssetIndex(assetIndex.serialize());
+    compressFiles(inputFilePaths, outputFilePath, fat);
+}
+
+void Compressor::compressFiles(const std::vector<std::wstring>& inputFilePaths, LPCWSTR outputFilePath, Fat& fat)
+{
+    fat.m_fileSize = 0;
+    fat.m_chunkSize = m_chunkSize;
+    fat.m_solidChunksCount = m_solidChunksCount;
 
-    if (remainingDataInByte)
+    for (size_t i = 0; i < inputFilePaths.size(); ++i)
     {
-        ManagedViewHandle mapFile = createReadMapViewOfFile(fileMapping.get(), bigFileAlignedSize, remainingDataInByte);
+        size_t inputFileSize = fileSize(createReadFile(inputFilePaths[i].c_str()).get()).QuadPart;
+        bool isLastFile = i + 1 == inputFilePaths.size();
+
+        fat.m_fileSize = isLastFile ? fat.m_fileSize + inputFileSize : align(fat.m_fileSize + inputFileSize, m_chunkSize);
+    }
+
+    /// the deadline covers the dictionary training as well
+    if (m_throughputController)
+    {
+        m_throughputController->start(fat.m_fileSize);
+    }
 
-        auto chunks = splitLastUnalignedBytes(mapFile.get(), remainingDataInByte);
-        auto compressedChunks = compressChunks(std::move(chunks));
-        writeCompressedChunksToFile(std::move(compressedChunks), outputFilePath);
-        getFat(fat, std::move(compressedChunks));
+    m_dictionary.clear();
+
+    if (m_dictionarySize != 0)
+    {
+        m_dictionary = DictionaryTrainer::train(sampleChunks(inputFilePaths), m_dictionarySize);
     }
 
-    fat.m_fileSize = bigFileSize.QuadPart;
-    fat.writeToFile(FAT_FILE_PATH);
+    fat.setDictionary(m_dictionary);
+
+    /// the archive is self contained, start it from scratch
+    DeleteFile(outputFilePath);
+    ManagedHandle outputFile = createWriteFile(outputFilePath);
+    fat.writeHeader(outputFile.get());
+
+    /// one worker per core by default, the writer parks at most a few groups per worker behind a slow one, pigz style
+    const size_t workersCount = Parallelism::workersCount();
+    ChunkPipeline pipeline(workersCount, 4 * workersCount * m_solidChunksCount);
+
+    pipeline.run(
+        [&] { readChunks(inputFilePaths, pipeline); },
+        [&] { compressChunks(pipeline); },
+        [&](ChunkTask& chunkTask) { writeCompressedChunk(chunkTask, outputFile.get(), fat); });
+
+    fat.writeTrailer(outputFile.get());
 }
 
-size_t Compressor::zlibCompress(const void* source, void* dest, size_t sourceBytesCount)
+void Compressor::readChunks(const std::vector<std::wstring>& inputFilePaths, ChunkPipeline& pipeline)
 {
-    int ret, flush;
-    unsigned have;
-    z_stream stream;
-    void* currentDest = dest;
-
-    uint8_t output[PAGE_SIZE];
+    size_t chunkIndex = 0;
+    ChunkGroup group;
 
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    ret = deflateInit(&stream, COMPRESSION_LEVEL);
-    assert(ret == Z_OK);
+    /// first chunk seen with each content, later copies become references to it. Done here, in file order,
+    /// so references always go back and the archive doesn't depend on the workers timing
+    UniqueChunks uniqueChunks;
 
-    flush = Z_FINISH;
-    stream.avail_in = static_cast<uInt>(sourceBytesCount);
-    stream.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(source));
+    /// first chunk of each file, to find a referenced chunk back in its file
+    std::vector<size_t> filesFirstChunk;
 
-    do
+    for (size_t fileIndex = 0; fileIndex < inputFilePaths.size(); ++fileIndex)
     {
-        stream.avail_out = PAGE_SIZE;
-        stream.next_out = output;
+        filesFirstChunk.push_back(chunkIndex);
 
-        ret = deflate(&stream, flush);
-        assert(ret != Z_STREAM_ERROR);
+        ManagedHandle inputFile = createReadFile(inputFilePaths[fileIndex].c_str());
+        const size_t bigFileSize = fileSize(inputFile.get()).QuadPart;
+        const bool isLastFile = fileIndex + 1 == inputFilePaths.size();
 
-        /// how many bytes have been written
-        have = PAGE_SIZE - stream.avail_out;
+        /// an empty file takes no chunks, and it can't be mapped
+        if (bigFileSize == 0)
+        {
+            continue;
+        }
 
-        /// copy the output to dest
-        if (have != 0)
+        ManagedHandle fileMapping = createReadFileMapping(inputFile.get(), 0);
+
+        /// map a big window of the file at a time and hand out chunks that point straight into it
+        for (size_t windowStart = 0; windowStart < bigFileSize; windowStart += INPUT_WINDOW_SIZE)
         {
-            memcpy(currentDest, output, have);
+            LARGE_INTEGER offset;
+            offset.QuadPart = windowStart;
+
+            size_t windowSize = std::min(INPUT_WINDOW_SIZE, bigFileSize - windowStart);
+            std::shared_ptr<void> window = createReadMapViewOfFile(fileMapping.get(), offset, windowSize);
+
+            for (size_t chunkStart = 0; chunkStart < windowSize; chunkStart += m_chunkSize)
+            {
+                const uint8_t* chunkData = reinterpret_cast<const uint8_t*>(window.get()) + chunkStart;
+                size_t chunkSize = std::min(m_chunkSize, windowSize - chunkStart);
+                std::shared_ptr<void> chunkWindow = window;
+
+                /// the next file starts on a chunk boundary, pad the tail of this one with zeros
+                if (chunkSize < m_chunkSize && !isLastFile)
+                {
+                    auto paddedChunk = std::make_shared<Chunk>(m_chunkSize);
+                    uint8_t* paddedData = reinterpret_cast<uint8_t*>(paddedChunk->m_memory.get());
+
+                    memcpy(paddedData, chunkData, chunkSize);
+                    memset(paddedData + chunkSize, 0, m_chunkSize - chunkSize);
+
+                    chunkWindow = std::shared_ptr<void>(paddedChunk, paddedData);
+                    chunkData = paddedData;
+                    chunkSize = m_chunkSize;
+                }
+
+                ChunkView view = classifyChunk(chunkIndex++, chunkData, chunkSize, chunkWindow, uniqueChunks);
+
+                /// equal hashes only make the chunks likely equal, a collision would silently restore the wrong data
+                if (view.m_type == ChunkType::Reference && !isSameChunk(inputFilePaths, filesFirstChunk, view))
+                {
+                    view.m_type = ChunkType::Deflated;
+                }
+
+                group.push_back(std::move(view));
+
+                /// the group waits until the writer is close enough to its chunks
+                if (group.size() == m_solidChunksCount)
+                {
+                    if (!pipeline.push(std::move(group), chunkIndex))
+                    {
+                        return;
+                    }
+
+                    group.clear();
+                }
+            }
         }
-        currentDest = reinterpret_cast<uint8_t*>(currentDest) + have;
+    }
 
-    } while (stream.avail_out == 0);
+    /// the last group may be short
+    if (!group.empty())
+    {
+        pipeline.push(std::move(group), chunkIndex);
+    }
+}
+
+Compressor::ChunkView Compressor::classifyChunk(size_t chunkIndex, const uint8_t* chunkData, size_t chunkSize, std::shared_ptr<void> window, UniqueChunks& uniqueChunks)
+{
+    ChunkView view = { chunkIndex, chunkData, chunkSize, std::move(window), ChunkType::Deflated, 0 };
 
-    assert(ret == Z_STREAM_END);
-    assert(stream.avail_in == 0);
+    /// a fill chunk is cheaper than a reference
+    if (isConstant(chunkData, chunkSize))
+    {
+        view.m_type = ChunkType::Fill;
+    }
+    else
+    {
+        auto uniqueChunk = uniqueChunks.emplace(MurmurHash3::hash128(chunkData, chunkSize), chunkIndex);
 
-    (void)deflateEnd(&stream);
+        if (!uniqueChunk.second)
+        {
+            view.m_type = ChunkType::Reference;
+            view.m_referencedChunk = uniqueChunk.first->second;
+        }
+    }
 
-    /// return the size of the compressed data
-    uintptr_t compressedSize = reinterpret_cast<uintptr_t>(currentDest) - reinterpret_cast<uintptr_t>(dest);
-    return compressedSize;
+    return view;
 }
 
-std::vector<std::unique_ptr<Chunk>> Compressor::splitFile(uint8_t* fileContent, size_t pageCount, size_t pageSize)
+bool Compressor::isSameChunk(const std::vector<std::wstring>& inputFilePaths, const std::vector<size_t>& filesFirstChunk, const ChunkView& view) const
 {
-    std::vector<std::unique_ptr<Chunk>> result;
+    /// empty files take no chunks, the referenced chunk is in the last file starting at or before it
+    const size_t fileIndex = std::upper_bound(filesFirstChunk.begin(), filesFirstChunk.end(), view.m_referencedChunk) - filesFirstChunk.begin() - 1;
+    const size_t chunkOffset = (view.m_referencedChunk - filesFirstChunk[fileIndex]) * m_chunkSize;
 
-    for (size_t i = 0; i < pageCount; ++i)
+    ManagedHandle inputFile = createReadFile(inputFilePaths[fileIndex].c_str());
+    const size_t bigFileSize = fileSize(inputFile.get()).QuadPart;
+    const size_t dataSize = std::min(m_chunkSize, bigFileSize - chunkOffset);
+
+    /// the tail chunk of every file but the last one was padded with zeros
+    const size_t referencedSize = fileIndex + 1 == inputFilePaths.size() ? dataSize : m_chunkSize;
+
+    if (referencedSize != view.m_size || !std::all_of(view.m_data + dataSize, view.m_data + view.m_size, [](uint8_t b) { return b == 0; }))
     {
-        result.emplace_back(std::make_unique<Chunk>(pageSize));
+        return false;
     }
 
-    concurrency::parallel_for(size_t(0), size_t(pageCount), [&result, fileContent, &pageSize](size_t i)
-    {
-        void* currentChunkPtr = result[i]->m_memory.get();
-        memcpy(currentChunkPtr, fileContent + i * pageSize, pageSize);
-    });
+    /// the window holding the referenced chunk is long gone, map the chunk again from its file
+    LARGE_INTEGER viewOffset;
+    viewOffset.QuadPart = alignDown(chunkOffset, ALLOCATION_GRANULARITY);
+    const size_t leadSize = chunkOffset - viewOffset.QuadPart;
 
-    return result;
+    ManagedHandle fileMapping = createReadFileMapping(inputFile.get(), 0);
+    ManagedViewHandle chunkView = createReadMapViewOfFile(fileMapping.get(), viewOffset, leadSize + dataSize);
+
+    return memcmp(reinterpret_cast<const uint8_t*>(chunkView.get()) + leadSize, view.m_data, dataSize) == 0;
 }
 
-std::vector<std::unique_ptr<Chunk>> Compressor::compressChunks(std::vector<std::unique_ptr<Chunk>>&& chunks)
+std::vector<uint8_t> Compressor::sampleChunks(const std::vector<std::wstring>& inputFilePaths) const
 {
-    std::vector<std::unique_ptr<Chunk>> result;
-    result.resize(chunks.size());
+    size_t inputSize = 0;
 
-    concurrency::parallel_for(size_t(0), chunks.size(), [this, &chunks, &result](size_t i)
+    for (const std::wstring& inputFilePath : inputFilePaths)
     {
-        std::unique_ptr<uint8_t[]> mem(reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, PAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE)));
+        inputSize += align(fileSize(createReadFile(inputFilePath.c_str()).get()).QuadPart, m_chunkSize);
+    }
 
-        uint64_t compressedSize = zlibCompress(chunks[i]->m_memory.get(), mem.get(), chunks[i]->chunkSize);
+    /// one chunk out of sampleStride
+    const size_t sampleStride = std::max<size_t>(1, inputSize / DICTIONARY_SAMPLES_SIZE);
 
-        result[i] = std::make_unique<Chunk>(mem.release(), compressedSize);
-    });
+    std::vector<uint8_t> samples;
+    Chunk chunk(m_chunkSize);
+    uint8_t* chunkMem = reinterpret_cast<uint8_t*>(chunk.m_memory.get());
+    size_t chunkIndex = 0;
+
+    for (const std::wstring& inputFilePath : inputFilePaths)
+    {
+        ManagedHandle inputFile = createReadFile(inputFilePath.c_str());
+        const size_t inputFileSize = fileSize(inputFile.get()).QuadPart;
+
+        for (size_t chunkStart = 0; chunkStart < inputFileSize; chunkStart += m_chunkSize, ++chunkIndex)
+        {
+            if (chunkIndex % sampleStride != 0)
+            {
+                continue;
+            }
+
+            LARGE_INTEGER offset;
+            offset.QuadPart = chunkStart;
+
+            DWORD readCount;
+            throwIfFalse(SetFilePointerEx(inputFile.get(), offset, nullptr, FILE_BEGIN));
+            throwIfFalse(ReadFile(inputFile.get(), chunkMem, static_cast<DWORD>(std::min(m_chunkSize, inputFileSize - chunkStart)), &readCount, nullptr));
+
+            /// constant chunks become fills, they have nothing to teach the dictionary
+            if (readCount != 0 && !isConstant(chunkMem, readCount))
+            {
+                samples.insert(samples.end(), chunkMem, chunkMem + readCount);
+            }
+        }
+    }
 
-    return result;
+    return samples;
 }
 
-void Compressor::writeCompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& compressedChunks, LPCWSTR filePath)
+void Compressor::compressChunks(ChunkPipeline& pipeline)
 {
-    ManagedHandle outputFile = createWriteFile(filePath);
+    ChunkGroup group;
 
-    for (size_t i = 0; i < compressedChunks.size(); ++i)
+    while (pipeline.pop(group))
     {
-        uint8_t* chunkMem = reinterpret_cast<uint8_t*>(compressedChunks[i]->m_memory.get());
-        size_t size = compressedChunks[i]->chunkSize;
+        /// the highest level and the strategy the throughput controller allows right now
+        const int maxLevel = m_throughputController ? m_throughputController->maxLevel() : COMPRESSION_LEVEL;
+        const int controllerStrategy = m_throughputController ? m_throughputController->strategy() : Z_DEFAULT_STRATEGY;
 
-        DWORD written;
-        BOOL ret = WriteFile(outputFile.get(), chunkMem, static_cast<DWORD>(size), &written, nullptr);
-        assert(ret == TRUE);
+        /// only the Solid chunks of the group go through its stream, fill and reference chunks stay out of it
+        ZStreamPool::Stream solidStream;
+
+        if (m_solidChunksCount > 1)
+        {
+            solidStream = ZStreamPool::acquireDeflate(maxLevel, -MAX_WBITS, controllerStrategy);
+
+            if (!m_dictionary.empty())
+            {
+                throwIfFalse(deflateSetDictionary(&solidStream->m_stream, m_dictionary.data(), static_cast<uInt>(m_dictionary.size())) == Z_OK);
+            }
+        }
+
+        for (ChunkView& view : group)
+        {
+            const auto chunkStart = std::chrono::steady_clock::now();
+            const size_t inputBytes = view.m_size;
+            int deflateLevel = 0;
+            int deflateStrategy = Z_DEFAULT_STRATEGY;
+
+            ChunkTask task;
+            task.m_index = view.m_index;
+            task.m_checksums.m_decompressed = Crc32c::compute(view.m_data, view.m_size);
+
+            /// zero filled regions and repeated chunks are common, neither costs a payload nor a deflate
+            if (view.m_type == ChunkType::Fill)
+            {
+                task.m_type = ChunkType::Fill;
+                task.m_parameter = view.m_data[0];
+                task.m_checksums.m_compressed = Crc32c::compute(view.m_data, 0);
+            }
+            else if (view.m_type == ChunkType::Reference)
+            {
+                task.m_type = ChunkType::Reference;
+                task.m_referencedChunk = view.m_referencedChunk;
+                task.m_checksums.m_compressed = Crc32c::compute(view.m_data, 0);
+            }
+            else if (solidStream)
+            {
+                /// part of a stream, it can't fall back to Stored once deflate has seen it
+                task.m_type = ChunkType::Solid;
+                task.m_chunk = zlibCompressSolid(solidStream->m_stream, view.m_data, view.m_size);
+                deflateLevel = maxLevel;
+                deflateStrategy = controllerStrategy;
+                task.m_checksums.m_compressed = Crc32c::compute(task.m_chunk->m_memory.get(), task.m_chunk->chunkSize);
+            }
+            else
+            {
+                /// run heavy and random looking chunks don't go through the level 9 search
+                DeflateStrategy::Choice choice = DeflateStrategy::choose(view.m_data, view.m_size);
+                choice.m_level = std::min(choice.m_level, maxLevel);
+
+                /// runs stay with Z_RLE, about as fast as Huffman only and much smaller on them
+                if (controllerStrategy == Z_HUFFMAN_ONLY && choice.m_strategy != Z_RLE)
+                {
+                    choice.m_strategy = Z_HUFFMAN_ONLY;
+                }
+
+                if (!choice.m_isStored && (task.m_chunk = zlibCompress(view.m_data, view.m_size, choice.m_level, choice.m_strategy)))
+                {
+                    deflateLevel = choice.m_level;
+                    deflateStrategy = choice.m_strategy;
+                    task.m_type = ChunkType::Deflated;
+                    task.m_parameter = ArchiveFormat::deflateParameter(choice.m_level, choice.m_strategy);
+                    task.m_checksums.m_compressed = Crc32c::compute(task.m_chunk->m_memory.get(), task.m_chunk->chunkSize);
+                }
+                else
+                {
+                    /// incompressible, keep the view so the writer copies the raw bytes from the input window
+                    task.m_type = ChunkType::Stored;
+                    task.m_checksums.m_compressed = task.m_checksums.m_decompressed;
+                    task.m_view = std::move(view);
+                }
+            }
+
+            /// let go of the window as soon as possible so it can be unmapped
+            view.m_window.reset();
+
+            if (m_throughputController)
+            {
+                size_t outputBytes = task.m_chunk ? task.m_chunk->chunkSize : (task.m_type == ChunkType::Stored ? inputBytes : 0);
+                m_throughputController->record(deflateLevel, deflateStrategy, inputBytes, outputBytes, std::chrono::steady_clock::now() - chunkStart);
+            }
+
+            if (!pipeline.emit(std::move(task)))
+            {
+                return;
+            }
+        }
     }
 }
 
-void Compressor::getFat(Fat& fat, std::vector<std::unique_ptr<Chunk>>&& compressedChunks)
+void Compressor::writeCompressedChunk(ChunkTask& chunkTask, HANDLE outputFile, Fat& fat)
 {
-    if (fat.m_chunksSizes.size() == 0)
+    if (chunkTask.m_type == ChunkType::Reference)
     {
-        fat.m_chunksSizes.push_back(0);
+        fat.addReferenceChunk(chunkTask.m_referencedChunk, chunkTask.m_checksums);
+        return;
     }
 
-    for (size_t i = 0; i < compressedChunks.size(); ++i)
+    size_t size = 0;
+
+    if (chunkTask.m_type != ChunkType::Fill)
     {
-        size_t prevOffset = fat.m_chunksSizes.back();
-        fat.m_chunksSizes.push_back(compressedChunks[i]->chunkSize + prevOffset);
+        bool isStored = chunkTask.m_type == ChunkType::Stored;
+
+        const void* chunkMem = isStored ? chunkTask.m_view.m_data : chunkTask.m_chunk->m_memory.get();
+        size = isStored ? chunkTask.m_view.m_size : chunkTask.m_chunk->chunkSize;
+
+        DWORD written;
+        throwIfFalse(WriteFile(outputFile, chunkMem, static_cast<DWORD>(size), &written, nullptr));
     }
-}
 
+    fat.addChunk(size, chunkTask.m_type, chunkTask.m_parameter, chunkTask.m_checksums);
+}
 
-std::vector<std::unique_ptr<Chunk>> Compressor::splitLastUnalignedBytes(void* mapViewOfLastChunk, size_t chunkSizeInBytes)
+std::unique_ptr<Chunk> Compressor::zlibCompress(const void* source, size_t sourceBytesCount, int level, int strategy)
 {
-    size_t chunksCount = chunkSizeInBytes / PAGE_SIZE;
-    size_t alignedBytesCount = alignDown(chunkSizeInBytes, PAGE_SIZE);
-    size_t trailBytesCount = chunkSizeInBytes - alignedBytesCount;
-
-    std::vector<std::unique_ptr<Chunk>> chunks;
+    ZStreamPool::Stream pooledStream = ZStreamPool::acquireDeflate(level, MAX_WBITS, strategy);
+    z_stream& stream = pooledStream->m_stream;
 
-    /// split the chunks
-    if (chunksCount)
+    if (!m_dictionary.empty())
     {
-        /// we have at least one chunk, so create the chunks and create the last chunk with remaining unaligned bytes
-        chunks = splitFile(reinterpret_cast<uint8_t*>(mapViewOfLastChunk), chunksCount, PAGE_SIZE);
-        mapViewOfLastChunk = reinterpret_cast<uint8_t*>(mapViewOfLastChunk) + alignedBytesCount;
-
-        /// if we have trailing bytes that are less than PAGE_SIZE
-        if (trailBytesCount)
-        {
-            auto lastUnalignedChunk = splitFile(reinterpret_cast<uint8_t*>(mapViewOfLastChunk), 1, trailBytesCount);
-            chunks.emplace_back(std::move(lastUnalignedChunk[0]));
-        }
+        throwIfFalse(deflateSetDictionary(&stream, m_dictionary.data(), static_cast<uInt>(m_dictionary.size())) == Z_OK);
     }
-    else
+
+    /// only room for a result smaller than the source, deflate gives up as soon as that runs out
+    /// instead of spending the whole effort on data that will be stored anyway
+    size_t destBytesCount = sourceBytesCount - 1;
+    auto dest = std::make_unique<Chunk>(destBytesCount);
+
+    stream.avail_in = static_cast<uInt>(sourceBytesCount);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(source));
+    stream.avail_out = static_cast<uInt>(destBytesCount);
+    stream.next_out = reinterpret_cast<Bytef*>(dest->m_memory.get());
+
+    int ret = deflate(&stream, Z_FINISH);
+    assert(ret != Z_STREAM_ERROR);
+
+    if (ret != Z_STREAM_END)
     {
-        /// the content are less than one chunk so just create 1 chunk of that size
-        chunks.emplace_back(std::make_unique<Chunk>(chunkSizeInBytes));
-        memcpy(chunks[0]->m_memory.get(), mapViewOfLastChunk, chunkSizeInBytes);
+        return nullptr;
     }
 
-    return chunks;
-}
\ No newline at end of file
+    /// the size of the compressed data
+    dest->chunkSize = destBytesCount - stream.avail_out;
+    return dest;
+}
+
+std::unique_ptr<Chunk> Compressor::zlibCompressSolid(z_stream& stream, const void* source, size_t sourceBytesCount)
+{
+    /// the bound of a whole stream plus the empty stored block of the sync flush
+    size_t destBytesCount = deflateBound(&stream, static_cast<uLong>(sourceBytesCount)) + 16;
+    auto dest = std::make_unique<Chunk>(destBytesCount);
+
+    stream.avail_in = static_cast<uInt>(sourceBytesCount);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(source));
+    stream.avail_out = static_cast<uInt>(destBytesCount);
+    stream.next_out = reinterpret_cast<Bytef*>(dest->m_memory.get());
+
+    /// the sync flush byte aligns the end of the chunk without emptying the window for the next one
+    int ret = deflate(&stream, Z_SYNC_FLUSH);
+    throwIfFalse(ret == Z_OK && stream.avail_in == 0 && stream.avail_out != 0);
+
+    dest->chunkSize = destBytesCount - stream.avail_out;
+    return dest;
+}
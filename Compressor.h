@@ -1,26 +1,105 @@
 #pragma once
 #include "pch.h"
-
-struct Fat;
+#include "Pipeline.h"
+#include "Fat.h"
+#include "MurmurHash3.h"
+#include "ThroughputController.h"
+#include <string>
+#include <unordered_map>
 
 class Compressor
 {
+    /* a chunk of the input file viewed in place, m_window keeps the mapped view alive. The reader already
+       knows constant chunks (Fill) and repeats of an earlier chunk (Reference), the rest is Deflated or Stored
+       once the worker tried to deflate it */
+    struct ChunkView
+    {
+        size_t m_index;
+        const uint8_t* m_data;
+        size_t m_size;
+        std::shared_ptr<void> m_window;
+        ChunkType m_type;
+        size_t m_referencedChunk;
+    };
+
+    /* a chunk on its way to the writer, m_index is its position in the original file. Deflated and Solid
+       chunks own their data in m_chunk, stored chunks are written from the input window through m_view and
+       fill and reference chunks have no data, only their byte in m_parameter or their m_referencedChunk */
+    struct ChunkTask
+    {
+        ChunkTask() : m_index(0), m_type(ChunkType::Deflated), m_parameter(0), m_referencedChunk(0), m_checksums() {}
+
+        size_t m_index;
+        ChunkType m_type;
+        uint8_t m_parameter;
+        size_t m_referencedChunk;
+        ArchiveFormat::ChunkChecksums m_checksums;
+        std::unique_ptr<Chunk> m_chunk;
+        ChunkView m_view;
+    };
+
+    /// the chunks of a solid group, a worker compresses a whole group
+    using ChunkGroup = std::vector<ChunkView>;
+
+    using ChunkPipeline = Pipeline<ChunkGroup, ChunkTask>;
+
+    /// first chunk seen with each content
+    using UniqueChunks = std::unordered_map<MurmurHash3::Hash128, size_t, MurmurHash3::Hash128Hasher>;
+
 public:
-    Compressor();
+    /* chunkSize is the random access granularity of the archive, a power of two in [MIN_CHUNK_SIZE, MAX_CHUNK_SIZE].
+       solidChunksCount consecutive chunks share one deflate stream, which improves the ratio on data repeating
+       across chunks but makes a random read inflate up to the whole group, 1 keeps every chunk on its own.
+       dictionarySize up to ArchiveFormat::MAX_DICTIONARY_SIZE trains a preset dictionary on samples of the
+       input, which gives small chunks part of the ratio of bigger ones, 0 compresses without a dictionary */
+    Compressor(size_t chunkSize = PAGE_SIZE, size_t solidChunksCount = 1, size_t dictionarySize = 0);
 
     void compress(LPCWSTR inputFilePath, LPCWSTR outputFilePath);
 
+    /* caps the deflate level of the next compressions, down to Huffman only deflate when even level 1 is too slow,
+       to hold the throughput or the deadline of controller. nullptr compresses every chunk at its best level again */
+    void setThroughputController(std::unique_ptr<ThroughputController> controller);
+
+    /* the controller of the last compression with its per level statistics, nullptr without one */
+    const ThroughputController* throughputController() const;
+
+    /* packs every file under inputDirectoryPath into one archive with an asset index, the assets are named by
+       their path relative to inputDirectoryPath with '/' separators */
+    void compressDirectory(LPCWSTR inputDirectoryPath, LPCWSTR outputFilePath);
+
 private:
-    size_t zlibCompress(const void* source, void* dest, size_t sourceBytesCount);
+    /* compresses the files one after the other, each but the last one padded with zeros up to a chunk boundary */
+    void compressFiles(const std::vector<std::wstring>& inputFilePaths, LPCWSTR outputFilePath, Fat& fat);
 
-    std::vector<std::unique_ptr<Chunk>> splitFile(uint8_t* fileContent, size_t pageCount, size_t pageSize);
 
-    std::vector<std::unique_ptr<Chunk>> compressChunks(std::vector<std::unique_ptr<Chunk>>&& chunks);
+    /* samples of the non constant chunks of the input files to train the dictionary on */
+    std::vector<uint8_t> sampleChunks(const std::vector<std::wstring>& inputFilePaths) const;
 
-    void writeCompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& compressedChunks, LPCWSTR filePath);
+    /* deflate source into a new chunk with the given level and zlib strategy, nullptr if the data doesn't get any smaller */
+    std::unique_ptr<Chunk> zlibCompress(const void* source, size_t sourceBytesCount, int level, int strategy);
 
-    void getFat(Fat& fat, std::vector<std::unique_ptr<Chunk>>&& compressedChunks);
+    /* deflate source as the next part of the raw deflate stream of a solid group, up to a sync flush */
+    std::unique_ptr<Chunk> zlibCompressSolid(z_stream& stream, const void* source, size_t sourceBytesCount);
 
-    std::vector<std::unique_ptr<Chunk>> splitLastUnalignedBytes(void* mapViewOfLastChunk, size_t chunkSizeInBytes);
-};
+    /* pipeline stages, they all run at the same time, the writer gets the chunks in order one at a time */
+    void readChunks(const std::vector<std::wstring>& inputFilePaths, ChunkPipeline& pipeline);
+
+    void compressChunks(ChunkPipeline& pipeline);
+
+    void writeCompressedChunk(ChunkTask& chunkTask, HANDLE outputFile, Fat& fat);
+
+    /* what the reader already knows about a chunk, whether it is constant or a repeat of an earlier one */
+    ChunkView classifyChunk(size_t chunkIndex, const uint8_t* chunkData, size_t chunkSize, std::shared_ptr<void> window, UniqueChunks& uniqueChunks);
 
+    /* whether the Reference view really has the bytes of its referenced chunk, read back from the input file */
+    bool isSameChunk(const std::vector<std::wstring>& inputFilePaths, const std::vector<size_t>& filesFirstChunk, const ChunkView& view) const;
+
+    size_t m_chunkSize;
+    size_t m_solidChunksCount;
+    size_t m_dictionarySize;
+
+    /// preset dictionary of the archive being compressed
+    std::vector<uint8_t> m_dictionary;
+
+    std::unique_ptr<ThroughputController> m_throughputController;
+};
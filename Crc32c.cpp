@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "Crc32c.h"
+#include <intrin.h>
+#include <nmmintrin.h>
+
+namespace
+{
+    const uint32_t POLYNOMIAL = 0x82F63B78;     /// Castagnoli, reflected
+
+    /* slicing by 8 tables, table[k][b] is the crc of byte b followed by k zero bytes */
+    struct Tables
+    {
+        Tables()
+        {
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                uint32_t crc = b;
+
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+                }
+
+                m_table[0][b] = crc;
+            }
+
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                for (int k = 1; k < 8; ++k)
+                {
+                    m_table[k][b] = (m_table[k - 1][b] >> 8) ^ m_table[0][m_table[k - 1][b] & 0xFF];
+                }
+            }
+        }
+
+        uint32_t m_table[8][256];
+    };
+
+    const Tables tables;
+
+    bool hasSse42()
+    {
+        int info[4];
+        __cpuid(info, 1);
+
+        return (info[2] & (1 << 20)) != 0;
+    }
+
+    const bool useHardware = hasSse42();
+
+    uint32_t computeHardware(const uint8_t* data, size_t size, uint32_t crc)
+    {
+#if defined(_M_X64)
+        uint64_t crc64 = crc;
+
+        for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+
+        crc = static_cast<uint32_t>(crc64);
+#else
+        /// the 64 bit form of the instruction only exists in x64 code
+        for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), data += sizeof(uint32_t))
+        {
+            uint32_t word;
+            memcpy(&word, data, sizeof(word));
+            crc = _mm_crc32_u32(crc, word);
+        }
+#endif
+
+        for (; size > 0; --size, ++data)
+        {
+            crc = _mm_crc32_u8(crc, *data);
+        }
+
+        return crc;
+    }
+
+    uint32_t computeTables(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        const auto& t = tables.m_table;
+
+        for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            word ^= crc;
+
+            crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF]
+                ^ t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        }
+
+        for (; size > 0; --size, ++data)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+        }
+
+        return crc;
+    }
+}
+
+uint32_t Crc32c::compute(const void* data, size_t size, uint32_t crc)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+    crc = ~crc;
+    crc = useHardware ? computeHardware(bytes, size, crc) : computeTables(bytes, size, crc);
+
+    return ~crc;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "pch.h"
+
+/* CRC32C (Castagnoli) of the archive chunks, with the SSE4.2 crc32 instruction when the CPU has it */
+namespace Crc32c
+{
+    /* crc of size bytes of data, pass the crc of the previous bytes to continue a running crc */
+    uint32_t compute(const void* data, size_t size, uint32_t crc = 0);
+}
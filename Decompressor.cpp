@@ -1,8 +1,13 @@
 #include "pch.h"
 #include "Decompressor.h"
 #include "CompressedFileMap.h"
+#include "Prefetcher.h"
 #include "Fat.h"
+#include "ZStreamPool.h"
+#include "Parallelism.h"
+#include "Crc32c.h"
 #include <ppl.h>
+#include <mutex>
 
 Decompressor::Decompressor()
 {
@@ -11,132 +16,478 @@ Decompressor::Decompressor()
 void Decompressor::decompress(LPCWSTR inputCompressedFilePath, LPCWSTR outputDecompressedFilePath)
 {
     Fat fat;
-    fat.readFromFile(FAT_FILE_PATH);
+    fat.readFromArchive(inputCompressedFilePath);
 
     CompressedFileMap compressedFileMap(inputCompressedFilePath);
 
-    size_t fatIndex = 0;
-    LARGE_INTEGER offset = { 0 };
+    /// zero fill chunks are never written, they stay holes of the preallocated file
+    ManagedHandle outputFile = createSparseFile(outputDecompressedFilePath, fat.m_fileSize);
 
-    while (fatIndex + CHUNKS_PER_MAP_COUNT < fat.m_chunksSizes.size())
+    /// a few chunks per core in each batch, made of whole solid groups since a group can't be inflated from the middle
+    const size_t batchChunksCount = Parallelism::batchChunksCount(fat.m_chunkSize, fat.m_solidChunksCount);
+
+    /// how many times each shared chunk is referenced, so a copy lives just as long as needed. The copies take
+    /// at most another batch, the archive can share many more chunks than fit in memory
+    SharedChunks sharedChunks = { {}, 0, batchChunksCount };
+    for (size_t i = 0; i < fat.referencesCount(); ++i)
+    {
+        ++sharedChunks.m_chunks[static_cast<size_t>(fat.reference(i).m_referencedChunk)].m_pendingReferences;
+    }
+
+    Prefetcher prefetcher(compressedFileMap, fat);
+
+    for (size_t fatIndex = 0; fatIndex < fat.chunksCount(); fatIndex += batchChunksCount)
     {
-        size_t viewSize = getViewSize(fatIndex, fat.m_chunksSizes);
-        uint8_t* compressedFileContent = reinterpret_cast<uint8_t*>(compressedFileMap.readMem(fat.m_chunksSizes[fatIndex], viewSize));
+        size_t fatEndIndex = std::min(fatIndex + batchChunksCount, fat.chunksCount());
+        size_t viewSize = fat.chunkOffset(fatEndIndex) - fat.chunkOffset(fatIndex);
 
-        auto decompressedChunks = decompressChunks(compressedFileContent, fat.m_chunksSizes, fatIndex);
-        writeDecompressedChunksToFile(std::move(decompressedChunks), outputDecompressedFilePath);
+        /// the next batch is read from disk while this one is inflated
+        prefetcher.prefetch(fatEndIndex, fatEndIndex + batchChunksCount);
+        CompressedFileMap::View compressedFileContent = compressedFileMap.readMem(fat.chunkOffset(fatIndex), viewSize);
 
-        fatIndex += CHUNKS_PER_MAP_COUNT;
+        auto decompressedChunks = decompressChunks(compressedFileMap, compressedFileContent.get(), fat, fatIndex, fatEndIndex, sharedChunks);
+        writeDecompressedChunksToFile(std::move(decompressedChunks), fat, fatIndex, outputFile.get());
     }
+}
+
+std::vector<size_t> Decompressor::verify(LPCWSTR inputCompressedFilePath)
+{
+    Fat fat;
+    fat.readFromArchive(inputCompressedFilePath);
 
-    /// decompress the rest unaligned chunks
-    if (fatIndex < fat.m_chunksSizes.size() - 1)
+    ManagedHandle archive = createReadFile(inputCompressedFilePath);
+    ManagedHandle archiveMapping = createReadFileMapping(archive.get(), fileSize(archive.get()).QuadPart);
+
+    std::mutex corruptedChunksMutex;
+    std::vector<size_t> corruptedChunks;
+
+    size_t firstChunk = 0;
+
+    while (firstChunk < fat.chunksCount())
     {
-        size_t viewSize = fat.m_chunksSizes.back() - fat.m_chunksSizes[fatIndex];
-        uint8_t* compressedFileContent = reinterpret_cast<uint8_t*>(compressedFileMap.readMem(fat.m_chunksSizes[fatIndex], viewSize));
+        /// map the archive in windows of whole solid groups, every core inflates groups of the window
+        size_t windowStart = alignDown(fat.chunkOffset(firstChunk), ALLOCATION_GRANULARITY);
+        size_t endChunk = std::min(firstChunk + fat.m_solidChunksCount, fat.chunksCount());
+
+        while (endChunk < fat.chunksCount()
+            && fat.chunkOffset(std::min(endChunk + fat.m_solidChunksCount, fat.chunksCount())) - windowStart <= INPUT_WINDOW_SIZE)
+        {
+            endChunk = std::min(endChunk + fat.m_solidChunksCount, fat.chunksCount());
+        }
 
-        auto decompressedChunks = decompressChunks(compressedFileContent, fat.m_chunksSizes, fatIndex);
-        writeDecompressedChunksToFile(std::move(decompressedChunks), outputDecompressedFilePath);
+        LARGE_INTEGER windowOffset;
+        windowOffset.QuadPart = windowStart;
+        ManagedViewHandle window = createReadMapViewOfFile(archiveMapping.get(), windowOffset, fat.chunkOffset(endChunk) - windowStart);
+        uint8_t* windowContent = reinterpret_cast<uint8_t*>(window.get());
+
+        concurrency::parallel_for(size_t(0), (endChunk - firstChunk + fat.m_solidChunksCount - 1) / fat.m_solidChunksCount, [&](size_t group)
+        {
+            size_t groupStart = firstChunk + group * fat.m_solidChunksCount;
+            size_t groupEnd = std::min(groupStart + fat.m_solidChunksCount, endChunk);
+
+            /// the Solid chunks after the first damaged one can't be inflated either
+            size_t solidEnd = groupStart;
+
+            try
+            {
+                solidEnd = inflateSolidChunks(fat, groupStart, groupEnd, windowContent + (fat.chunkOffset(groupStart) - windowStart),
+                    std::vector<uint8_t*>(groupEnd - groupStart, nullptr));
+            }
+            catch (std::exception&)
+            {
+            }
+
+            for (size_t i = groupStart; i < groupEnd; ++i)
+            {
+                bool isIntact = false;
+
+                /// a damaged FAT throws on lookup, that chunk is as corrupted as a damaged payload
+                try
+                {
+                    if (fat.chunkType(i) == ChunkType::Solid)
+                    {
+                        isIntact = i < solidEnd;
+                    }
+                    else if (fat.chunkType(i) == ChunkType::Reference)
+                    {
+                        isIntact = isReferenceIntact(fat, i);
+                    }
+                    else
+                    {
+                        Chunk decompressedChunk(fat.m_chunkSize);
+                        isIntact = tryDecompressChunk(fat, i, windowContent + (fat.chunkOffset(i) - windowStart), decompressedChunk.m_memory.get(), fat.m_chunkSize);
+                    }
+                }
+                catch (std::exception&)
+                {
+                }
+
+                if (!isIntact)
+                {
+                    std::lock_guard<std::mutex> lock(corruptedChunksMutex);
+                    corruptedChunks.push_back(i);
+                }
+            }
+        });
+
+        firstChunk = endChunk;
     }
+
+    std::sort(corruptedChunks.begin(), corruptedChunks.end());
+    return corruptedChunks;
+}
+
+size_t Decompressor::decompressChunk(const Fat& fat, size_t chunkIndex, void* source, void* dest, size_t destBytesCount)
+{
+    throwIfFalse(tryDecompressChunk(fat, chunkIndex, source, dest, destBytesCount));
+
+    return fat.chunkDecompressedSize(chunkIndex);
+}
+
+bool Decompressor::isCompressedChunkIntact(const Fat& fat, size_t chunkIndex, const void* source) const
+{
+    return Crc32c::compute(source, fat.compressedChunkSize(chunkIndex)) == fat.chunkChecksums(chunkIndex).m_compressed;
 }
 
-size_t Decompressor::zlibDecompress(void* source, void* dest, size_t sourceBytesCount)
+bool Decompressor::isFillChunkIntact(const Fat& fat, size_t chunkIndex) const
 {
-    int ret;
-    unsigned have;
-    z_stream stream;
-    void* currentDest = dest;
+    /// the FAT keeps only the fill byte, the checksum of the whole chunk is what catches a damaged one
+    uint8_t fill[4096];
+    memset(fill, fat.chunkParameter(chunkIndex), sizeof(fill));
 
-    uint8_t output[PAGE_SIZE];
+    uint32_t crc = 0;
 
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    stream.avail_in = 0;
-    stream.next_in = Z_NULL;
+    for (size_t remaining = fat.chunkDecompressedSize(chunkIndex); remaining != 0; remaining -= std::min(remaining, sizeof(fill)))
+    {
+        crc = Crc32c::compute(fill, std::min(remaining, sizeof(fill)), crc);
+    }
+
+    return fat.compressedChunkSize(chunkIndex) == 0 && crc == fat.chunkChecksums(chunkIndex).m_decompressed;
+}
 
-    ret = inflateInit(&stream);
-    assert(ret == Z_OK);
+bool Decompressor::isReferenceIntact(const Fat& fat, size_t chunkIndex) const
+{
+    size_t referencedChunk = fat.referencedChunk(chunkIndex);
+
+    /// both were the same bytes when compressed, the referenced chunk checksum covers the shared payload
+    return fat.compressedChunkSize(chunkIndex) == 0
+        && fat.chunkDecompressedSize(chunkIndex) == fat.chunkDecompressedSize(referencedChunk)
+        && fat.chunkChecksums(chunkIndex).m_decompressed == fat.chunkChecksums(referencedChunk).m_decompressed;
+}
+
+bool Decompressor::tryDecompressChunk(const Fat& fat, size_t chunkIndex, void* source, void* dest, size_t destBytesCount)
+{
+    size_t compressedChunkSize = fat.compressedChunkSize(chunkIndex);
+    size_t decompressedChunkSize = fat.chunkDecompressedSize(chunkIndex);
+
+    /// a damaged chunk is caught before inflate ever sees it
+    if (fat.chunkType(chunkIndex) == ChunkType::Reference || fat.chunkType(chunkIndex) == ChunkType::Solid
+        || decompressedChunkSize > destBytesCount || !isCompressedChunkIntact(fat, chunkIndex, source))
+    {
+        return false;
+    }
+
+    if (fat.chunkType(chunkIndex) == ChunkType::Fill)
+    {
+        if (!isFillChunkIntact(fat, chunkIndex))
+        {
+            return false;
+        }
+
+        memset(dest, fat.chunkParameter(chunkIndex), decompressedChunkSize);
+        return true;
+    }
+
+    if (fat.chunkType(chunkIndex) == ChunkType::Stored)
+    {
+        /// kept raw, no need to go through inflate, the compressed checksum covers the data
+        if (compressedChunkSize != decompressedChunkSize)
+        {
+            return false;
+        }
+
+        memcpy(dest, source, compressedChunkSize);
+        return true;
+    }
+
+    size_t decompressedBytesCount;
+
+    return zlibDecompress(source, dest, compressedChunkSize, destBytesCount, fat.dictionary(), decompressedBytesCount)
+        && decompressedBytesCount == decompressedChunkSize
+        && Crc32c::compute(dest, decompressedBytesCount) == fat.chunkChecksums(chunkIndex).m_decompressed;
+}
+
+bool Decompressor::zlibDecompress(void* source, void* dest, size_t sourceBytesCount, size_t destBytesCount, const std::vector<uint8_t>& dictionary,
+    size_t& decompressedBytesCount)
+{
+    ZStreamPool::Stream pooledStream = ZStreamPool::acquireInflate();
+    z_stream& stream = pooledStream->m_stream;
 
     stream.avail_in = static_cast<uInt>(sourceBytesCount);
     stream.next_in = reinterpret_cast<Bytef*>(source);
+    stream.avail_out = static_cast<uInt>(destBytesCount);
+    stream.next_out = reinterpret_cast<Bytef*>(dest);
 
-    do
-    {
-        stream.avail_out = PAGE_SIZE;
-        stream.next_out = output;
+    /// dest holds the whole chunk so a single call inflates it in place, once the dictionary is set if it asks for one
+    int ret = inflate(&stream, Z_FINISH);
 
+    if (ret == Z_NEED_DICT && !dictionary.empty()
+        && inflateSetDictionary(&stream, dictionary.data(), static_cast<uInt>(dictionary.size())) == Z_OK)
+    {
         ret = inflate(&stream, Z_FINISH);
-        assert(ret != Z_STREAM_ERROR);
-        
-        switch (ret)
+    }
+    decompressedBytesCount = destBytesCount - stream.avail_out;
+
+    return ret == Z_STREAM_END;
+}
+
+size_t Decompressor::inflateSolidChunks(const Fat& fat, size_t groupStart, size_t endChunk, const uint8_t* source, const std::vector<uint8_t*>& dests)
+{
+    /// most groups of an archive that isn't solid have no Solid chunk, they don't pay for a stream and its dictionary
+    size_t firstSolidChunk = groupStart;
+
+    while (firstSolidChunk < endChunk && fat.chunkType(firstSolidChunk) != ChunkType::Solid)
+    {
+        ++firstSolidChunk;
+    }
+
+    if (firstSolidChunk == endChunk)
+    {
+        return endChunk;
+    }
+
+    ZStreamPool::Stream pooledStream = ZStreamPool::acquireInflate(-MAX_WBITS);
+    z_stream& stream = pooledStream->m_stream;
+
+    /// a raw stream can't ask for its dictionary, it starts with it in the window
+    if (!fat.dictionary().empty())
+    {
+        throwIfFalse(inflateSetDictionary(&stream, fat.dictionary().data(), static_cast<uInt>(fat.dictionary().size())) == Z_OK);
+    }
+
+    /// inflate keeps its own copy of the window, the chunks nobody wants can all go to the same place
+    std::unique_ptr<Chunk> scratchChunk;
+    size_t groupOffset = fat.chunkOffset(groupStart);
+
+    for (size_t i = firstSolidChunk; i < endChunk; ++i)
+    {
+        if (fat.chunkType(i) != ChunkType::Solid)
         {
-        case Z_NEED_DICT:
-            ret = Z_DATA_ERROR;
-        case Z_DATA_ERROR:
-        case Z_MEM_ERROR:
-            (void)inflateEnd(&stream);
-            assert(false);
-        default:
-            break;
+            continue;
         }
 
-        have = PAGE_SIZE - stream.avail_out;
-        if (have != 0)
+        const uint8_t* compressedChunk = source + (fat.chunkOffset(i) - groupOffset);
+        size_t decompressedChunkSize = fat.chunkDecompressedSize(i);
+        uint8_t* dest = dests[i - groupStart];
+
+        if (!dest)
         {
-            memcpy(currentDest, output, have);
+            if (!scratchChunk)
+            {
+                scratchChunk = std::make_unique<Chunk>(fat.m_chunkSize);
+            }
+
+            dest = reinterpret_cast<uint8_t*>(scratchChunk->m_memory.get());
         }
-        currentDest = reinterpret_cast<uint8_t*>(currentDest) + have;
 
-    } while (stream.avail_out == 0);
+        if (!isCompressedChunkIntact(fat, i, compressedChunk))
+        {
+            return i;
+        }
 
-    (void)inflateEnd(&stream);
+        stream.avail_in = static_cast<uInt>(fat.compressedChunkSize(i));
+        stream.next_in = const_cast<Bytef*>(compressedChunk);
+        stream.avail_out = static_cast<uInt>(decompressedChunkSize);
+        stream.next_out = dest;
 
-    assert(ret == Z_STREAM_END);
+        /// dest is exactly the chunk, the empty block of the sync flush may still be left once it is full
+        int ret;
+        do
+        {
+            ret = inflate(&stream, Z_SYNC_FLUSH);
+        } while (ret == Z_OK && stream.avail_in != 0);
 
-    size_t decompressedSize = reinterpret_cast<uintptr_t>(currentDest) - reinterpret_cast<uintptr_t>(dest);
-    return decompressedSize;
+        if ((ret != Z_OK && ret != Z_BUF_ERROR) || stream.avail_in != 0 || stream.avail_out != 0
+            || Crc32c::compute(dest, decompressedChunkSize) != fat.chunkChecksums(i).m_decompressed)
+        {
+            return i;
+        }
+    }
+
+    return endChunk;
 }
 
-std::vector<std::unique_ptr<Chunk>> Decompressor::decompressChunks(uint8_t* compressedFileContent, std::vector<size_t>& fatChunkSizes, size_t fatStartIndex)
+std::vector<std::unique_ptr<Chunk>> Decompressor::decompressChunks(CompressedFileMap& compressedFileMap, uint8_t* compressedFileContent, const Fat& fat,
+    size_t fatStartIndex, size_t fatEndIndex, SharedChunks& sharedChunks)
 {
-    std::vector<std::unique_ptr<Chunk>> decompressedChunks;
+    std::vector<std::unique_ptr<Chunk>> decompressedChunks(fatEndIndex - fatStartIndex);
+    size_t groupsCount = (fatEndIndex - fatStartIndex + fat.m_solidChunksCount - 1) / fat.m_solidChunksCount;
+
+    concurrency::parallel_for(size_t(0), groupsCount, [this, &fat, &decompressedChunks, compressedFileContent, fatStartIndex, fatEndIndex](size_t group)
+    {
+        size_t groupStart = fatStartIndex + group * fat.m_solidChunksCount;
+        size_t groupEnd = std::min(groupStart + fat.m_solidChunksCount, fatEndIndex);
+        std::vector<uint8_t*> solidDests(groupEnd - groupStart, nullptr);
 
-    size_t fatEndIndex = (fatStartIndex + CHUNKS_PER_MAP_COUNT) >= fatChunkSizes.size() ? fatChunkSizes.size() - 1 : fatStartIndex + CHUNKS_PER_MAP_COUNT;
+        for (size_t i = groupStart; i < groupEnd; ++i)
+        {
+            /// references are copied once their referenced chunk is there
+            if (fat.chunkType(i) == ChunkType::Reference)
+            {
+                continue;
+            }
+
+            /// zero fills are left out, the output file already reads as zeros there. They are still checked, a
+            /// damaged fill byte that became a zero would pass for a hole
+            if (fat.chunkType(i) == ChunkType::Fill && fat.chunkParameter(i) == 0)
+            {
+                throwIfFalse(isFillChunkIntact(fat, i));
+                continue;
+            }
+
+            auto decompressedChunk = std::make_unique<Chunk>(fat.m_chunkSize);
+            decompressedChunk->chunkSize = fat.chunkDecompressedSize(i);
+
+            if (fat.chunkType(i) == ChunkType::Solid)
+            {
+                solidDests[i - groupStart] = reinterpret_cast<uint8_t*>(decompressedChunk->m_memory.get());
+            }
+            else
+            {
+                size_t offset = fat.chunkOffset(i) - fat.chunkOffset(fatStartIndex);
+                decompressChunk(fat, i, compressedFileContent + offset, decompressedChunk->m_memory.get(), fat.m_chunkSize);
+            }
+
+            decompressedChunks[i - fatStartIndex] = std::move(decompressedChunk);
+        }
 
-    decompressedChunks.resize(fatEndIndex - fatStartIndex);
+        size_t groupOffset = fat.chunkOffset(groupStart) - fat.chunkOffset(fatStartIndex);
+        throwIfFalse(inflateSolidChunks(fat, groupStart, groupEnd, compressedFileContent + groupOffset, solidDests) == groupEnd);
+    });
 
-    concurrency::parallel_for(fatStartIndex, fatEndIndex, [this, &fatChunkSizes, &decompressedChunks, &compressedFileContent, &fatStartIndex](size_t i)
+    concurrency::parallel_for(fatStartIndex, fatEndIndex, [this, &compressedFileMap, &fat, &decompressedChunks, fatStartIndex, &sharedChunks](size_t i)
     {
-        std::unique_ptr<uint8_t[]> mem(reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, PAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE)));
+        if (fat.chunkType(i) != ChunkType::Reference)
+        {
+            return;
+        }
 
-        size_t compressedChunkSize = fatChunkSizes[i + 1] - fatChunkSizes[i];
-        size_t offset = fatChunkSizes[i] - fatChunkSizes[fatStartIndex];
+        throwIfFalse(isReferenceIntact(fat, i));
+        size_t sourceChunk = fat.referencedChunk(i);
 
-        size_t decompressedSize = zlibDecompress(compressedFileContent + offset, mem.get(), compressedChunkSize);
+        auto decompressedChunk = std::make_unique<Chunk>(fat.m_chunkSize);
 
-        decompressedChunks[i % CHUNKS_PER_MAP_COUNT] = std::make_unique<Chunk>(mem.release(), decompressedSize);
+        /// decompressed by this batch or kept from an earlier one, copy it instead of inflating it again
+        const Chunk* referencedChunk = nullptr;
+
+        if (sourceChunk < fatStartIndex)
+        {
+            auto sharedChunk = sharedChunks.m_chunks.find(sourceChunk);
+            throwIfFalse(sharedChunk != sharedChunks.m_chunks.end());
+
+            referencedChunk = sharedChunk->second.m_chunk.get();
+        }
+        else
+        {
+            referencedChunk = decompressedChunks[sourceChunk - fatStartIndex].get();
+            throwIfFalse(referencedChunk != nullptr);
+        }
+
+        if (referencedChunk)
+        {
+            decompressedChunk->chunkSize = referencedChunk->chunkSize;
+            memcpy(decompressedChunk->m_memory.get(), referencedChunk->m_memory.get(), decompressedChunk->chunkSize);
+        }
+        else
+        {
+            redecompressChunk(compressedFileMap, fat, sourceChunk, *decompressedChunk);
+        }
+
+        decompressedChunks[i - fatStartIndex] = std::move(decompressedChunk);
     });
 
+    /// the chunks whose references all got written go first, their copies make room for the next ones
+    for (size_t i = fatStartIndex; i < fatEndIndex; ++i)
+    {
+        if (fat.chunkType(i) == ChunkType::Reference)
+        {
+            auto sharedChunk = sharedChunks.m_chunks.find(fat.referencedChunk(i));
+
+            if (--sharedChunk->second.m_pendingReferences == 0)
+            {
+                sharedChunks.m_copiesCount -= sharedChunk->second.m_chunk ? 1 : 0;
+                sharedChunks.m_chunks.erase(sharedChunk);
+            }
+        }
+    }
+
+    /// keep a copy of the shared chunks of this batch still referenced by the next ones, while there is room
+    for (size_t i = fatStartIndex; i < fatEndIndex && sharedChunks.m_copiesCount < sharedChunks.m_maxCopiesCount; ++i)
+    {
+        auto sharedChunk = sharedChunks.m_chunks.find(i);
+
+        if (sharedChunk != sharedChunks.m_chunks.end())
+        {
+            const Chunk& decompressedChunk = *decompressedChunks[i - fatStartIndex];
+
+            sharedChunk->second.m_chunk = std::make_unique<Chunk>(decompressedChunk.chunkSize);
+            sharedChunk->second.m_chunk->chunkSize = decompressedChunk.chunkSize;
+            memcpy(sharedChunk->second.m_chunk->m_memory.get(), decompressedChunk.m_memory.get(), decompressedChunk.chunkSize);
+
+            ++sharedChunks.m_copiesCount;
+        }
+    }
+
     return decompressedChunks;
 }
 
-size_t Decompressor::getViewSize(size_t fatIndex, std::vector<size_t>& fatChunksSizes)
+void Decompressor::redecompressChunk(CompressedFileMap& compressedFileMap, const Fat& fat, size_t chunkIndex, Chunk& dest)
 {
-    return fatChunksSizes[fatIndex + CHUNKS_PER_MAP_COUNT] - fatChunksSizes[fatIndex];
+    /// a Solid chunk can only be inflated after the ones before it in its group
+    size_t groupStart = fat.chunkType(chunkIndex) == ChunkType::Solid ? alignDown(chunkIndex, fat.m_solidChunksCount) : chunkIndex;
+
+    CompressedFileMap::View source = compressedFileMap.readMem(fat.chunkOffset(groupStart), fat.chunkOffset(chunkIndex + 1) - fat.chunkOffset(groupStart));
+    dest.chunkSize = fat.chunkDecompressedSize(chunkIndex);
+
+    if (fat.chunkType(chunkIndex) == ChunkType::Solid)
+    {
+        std::vector<uint8_t*> solidDests(chunkIndex + 1 - groupStart, nullptr);
+        solidDests.back() = reinterpret_cast<uint8_t*>(dest.m_memory.get());
+
+        throwIfFalse(inflateSolidChunks(fat, groupStart, chunkIndex + 1, source.get(), solidDests) == chunkIndex + 1);
+    }
+    else
+    {
+        decompressChunk(fat, chunkIndex, source.get(), dest.m_memory.get(), fat.m_chunkSize);
+    }
 }
 
-void Decompressor::writeDecompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& decompressedChunks, LPCWSTR filePath)
+void Decompressor::writeDecompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& decompressedChunks, const Fat& fat, size_t fatStartIndex, HANDLE outputFile)
 {
-    ManagedHandle outputFile = createWriteFile(filePath);
+    /// seek only past the skipped chunks, consecutive chunks follow each other
+    bool isFilePointerAtChunk = false;
 
     for (size_t i = 0; i < decompressedChunks.size(); ++i)
     {
+        if (!decompressedChunks[i])
+        {
+            isFilePointerAtChunk = false;
+            continue;
+        }
+
+        if (!isFilePointerAtChunk)
+        {
+            LARGE_INTEGER chunkOffset;
+            chunkOffset.QuadPart = (fatStartIndex + i) * fat.m_chunkSize;
+            throwIfFalse(SetFilePointerEx(outputFile, chunkOffset, nullptr, FILE_BEGIN));
+
+            isFilePointerAtChunk = true;
+        }
+
         uint8_t* chunkMem = reinterpret_cast<uint8_t*>(decompressedChunks[i]->m_memory.get());
         DWORD size = static_cast<DWORD>(decompressedChunks[i]->chunkSize);
 
         DWORD written;
-        BOOL ret = WriteFile(outputFile.get(), chunkMem, size, &written, nullptr);
-        assert(ret == TRUE);
+        throwIfFalse(WriteFile(outputFile, chunkMem, size, &written, nullptr));
     }
 }
\ No newline at end of file
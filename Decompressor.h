@@ -1,20 +1,70 @@
 #pragma once
 #include "pch.h"
+#include "Fat.h"
+#include "CompressedFileMap.h"
+#include <unordered_map>
 
 class Decompressor
 {
+    /* a chunk other chunks reference, with a decompressed copy in m_chunk while there is room for it */
+    struct SharedChunk
+    {
+        std::unique_ptr<Chunk> m_chunk;
+        size_t m_pendingReferences;
+    };
+
+    /* the chunks references still point to once the batches up to now are written. At most m_maxCopiesCount of
+       them keep their copy, the references to the others inflate them again from the archive */
+    struct SharedChunks
+    {
+        std::unordered_map<size_t, SharedChunk> m_chunks;
+        size_t m_copiesCount;
+        size_t m_maxCopiesCount;
+    };
+
 public:
     Decompressor();
 
     void decompress(LPCWSTR inputCompressedFilePath, LPCWSTR outputDecompressedFilePath);
 
+    /* checks every chunk of the archive against its checksums without writing anything, returns the corrupted chunks */
+    std::vector<size_t> verify(LPCWSTR inputCompressedFilePath);
+
+    /* decompress chunk chunkIndex of the fat from source straight into dest, returns the decompressed size.
+       Throws if the chunk doesn't match its checksums */
+    size_t decompressChunk(const Fat& fat, size_t chunkIndex, void* source, void* dest, size_t destBytesCount);
+
+    /* whether the chunk as stored in the archive matches its checksum, enough to trust a stored chunk */
+    bool isCompressedChunkIntact(const Fat& fat, size_t chunkIndex, const void* source) const;
+
+    /* whether the Fill chunk chunkIndex still fills to the bytes it was compressed from */
+    bool isFillChunkIntact(const Fat& fat, size_t chunkIndex) const;
+
+    /* whether the Reference chunk chunkIndex can be read from its referenced chunk, which gets checked on its own */
+    bool isReferenceIntact(const Fat& fat, size_t chunkIndex) const;
+
+    /* inflates the Solid chunks of the solid group starting at groupStart, in order, up to endChunk excluded.
+       source is the archive from the group start on and dests[i - groupStart] where chunk i goes, nullptr when
+       only the window for the next chunks matters. Returns the first chunk that doesn't match its checksums,
+       endChunk when they all do. A group without Solid chunks costs only the look at its chunk types */
+    size_t inflateSolidChunks(const Fat& fat, size_t groupStart, size_t endChunk, const uint8_t* source, const std::vector<uint8_t*>& dests);
+
 private:
-    size_t zlibDecompress(void* source, void* dest, size_t sourceBytesCount);
+    /* same as decompressChunk but returns false on a corrupted chunk. Reference chunks have no payload of
+       their own, the caller reads their referenced chunk instead, and Solid chunks need their whole group */
+    bool tryDecompressChunk(const Fat& fat, size_t chunkIndex, void* source, void* dest, size_t destBytesCount);
+
+    bool zlibDecompress(void* source, void* dest, size_t sourceBytesCount, size_t destBytesCount, const std::vector<uint8_t>& dictionary,
+        size_t& decompressedBytesCount);
 
-    std::vector<std::unique_ptr<Chunk>> decompressChunks(uint8_t* compressedFileContent, std::vector<size_t>& fatChunkSizes, size_t fatStartIndex);
+    /* decompresses the chunks [fatStartIndex, fatEndIndex), whole solid groups, one group per core. compressedFileContent
+       is the archive of these chunks, references to earlier chunks without a copy in sharedChunks read compressedFileMap */
+    std::vector<std::unique_ptr<Chunk>> decompressChunks(CompressedFileMap& compressedFileMap, uint8_t* compressedFileContent, const Fat& fat,
+        size_t fatStartIndex, size_t fatEndIndex, SharedChunks& sharedChunks);
 
-    size_t getViewSize(size_t fatIndex, std::vector<size_t>& fatChunksSizes);
+    /* decompresses chunk chunkIndex again straight from the archive into dest, from its group start for a Solid one */
+    void redecompressChunk(CompressedFileMap& compressedFileMap, const Fat& fat, size_t chunkIndex, Chunk& dest);
 
-    void writeDecompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& decompressedChunks, LPCWSTR filePath);
+    void writeDecompressedChunksToFile(std::vector<std::unique_ptr<Chunk>>&& decompressedChunks, const Fat& fat, size_t fatStartIndex, HANDLE outputFile);
 };
 
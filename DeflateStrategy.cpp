@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "DeflateStrategy.h"
+#include <cmath>
+
+namespace
+{
+    /// bits per byte above which a chunk without matches is left stored
+    const double STORED_ENTROPY = 7.9;
+
+    /// bits per byte below which a literal is cheaper than a minimal match
+    const double LITERALS_ENTROPY = 4.0;
+
+    /// share of the bytes deflate could cover with matches below which there are none worth the search
+    const double MIN_MATCH_COVERAGE = 0.1;
+
+    /// share of the bytes repeating the previous one from which the chunk is run heavy
+    const double RUNS_SHARE = 0.5;
+
+    /// average greedy match lengths
+    const double MINIMAL_MATCH_LENGTH = 3.5;
+    const double SHORT_MATCH_LENGTH = 8.0;
+
+    const int FAST_LEVEL = 1;
+    const int BINARY_LEVEL = 6;
+
+    const uint32_t MATCH_HASH_BITS = 12;
+    const size_t MIN_MATCH = 3;
+    const size_t MAX_MATCH = 258;
+
+    /* the same test as detect_data_type in trees.c: binary as soon as a byte of the block list shows up */
+    bool isBinary(const size_t* histogram)
+    {
+        /// 0..6, 14..25 and 28..31 can't be in text
+        const uint32_t blockList = 0xF3FFC07F;
+
+        for (int b = 0; b < 32; ++b)
+        {
+            if ((blockList >> b & 1) != 0 && histogram[b] != 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    double entropy(const size_t* histogram, size_t size)
+    {
+        double bits = 0;
+
+        for (int b = 0; b < 256; ++b)
+        {
+            if (histogram[b] != 0)
+            {
+                double probability = static_cast<double>(histogram[b]) / size;
+                bits -= probability * std::log2(probability);
+            }
+        }
+
+        return bits;
+    }
+
+    uint32_t trigram(const uint8_t* data)
+    {
+        return data[0] | data[1] << 8 | data[2] << 16;
+    }
+}
+
+DeflateStrategy::Choice DeflateStrategy::choose(const uint8_t* data, size_t size)
+{
+    size_t histogram[256] = {};
+    size_t runBytes = 0;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        ++histogram[data[i]];
+        runBytes += i != 0 && data[i] == data[i - 1];
+    }
+
+    /// greedy parse, the last position of each hashed trigram is the only candidate. 16 KB, on the stack since
+    /// every chunk goes through here
+    uint32_t lastPositions[size_t(1) << MATCH_HASH_BITS];
+    std::fill_n(lastPositions, size_t(1) << MATCH_HASH_BITS, UINT32_MAX);
+    size_t matchedBytes = 0;
+    size_t matchesCount = 0;
+
+    for (size_t i = 0; i + MIN_MATCH <= size;)
+    {
+        uint32_t value = trigram(data + i);
+        uint32_t& lastPosition = lastPositions[(value * 2654435761u) >> (32 - MATCH_HASH_BITS)];
+        uint32_t candidate = lastPosition;
+        lastPosition = static_cast<uint32_t>(i);
+
+        if (candidate == UINT32_MAX || trigram(data + candidate) != value)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (i + length < size && length < MAX_MATCH && data[candidate + length] == data[i + length])
+        {
+            ++length;
+        }
+
+        matchedBytes += length;
+        ++matchesCount;
+        i += length;
+    }
+
+    const double bitsPerByte = entropy(histogram, size);
+    const double matchCoverage = size != 0 ? static_cast<double>(matchedBytes) / size : 0;
+    const double averageMatchLength = matchesCount != 0 ? static_cast<double>(matchedBytes) / matchesCount : 0;
+
+    if (bitsPerByte >= STORED_ENTROPY && matchCoverage < MIN_MATCH_COVERAGE)
+    {
+        return { true, 0, Z_DEFAULT_STRATEGY };
+    }
+
+    if (size != 0 && static_cast<double>(runBytes) / size >= RUNS_SHARE)
+    {
+        return { false, COMPRESSION_LEVEL, Z_RLE };
+    }
+
+    if (matchCoverage < MIN_MATCH_COVERAGE)
+    {
+        return { false, COMPRESSION_LEVEL, Z_HUFFMAN_ONLY };
+    }
+
+    if (averageMatchLength < MINIMAL_MATCH_LENGTH)
+    {
+        return bitsPerByte < LITERALS_ENTROPY ? Choice{ false, COMPRESSION_LEVEL, Z_HUFFMAN_ONLY } : Choice{ false, FAST_LEVEL, Z_DEFAULT_STRATEGY };
+    }
+
+    if (averageMatchLength < SHORT_MATCH_LENGTH && isBinary(histogram))
+    {
+        return { false, BINARY_LEVEL, Z_DEFAULT_STRATEGY };
+    }
+
+    return { false, COMPRESSION_LEVEL, Z_DEFAULT_STRATEGY };
+}
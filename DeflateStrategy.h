@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+
+/* Picks how to deflate a chunk from cheap statistics of its bytes, so only the chunks that gain from it pay for
+   the level 9 match search. One pass gathers the byte histogram, the share of bytes repeating the previous
+   one and a greedy parse with a single candidate per hash bucket, which tells how much of the chunk deflate
+   could cover with matches and how long these are:
+       - random looking, high entropy and no matches: stored without deflating it
+       - mostly runs: Z_RLE, which only looks one byte back
+       - no matches: Z_HUFFMAN_ONLY
+       - only minimal matches: Z_HUFFMAN_ONLY when the literals are cheaper than a match, else level 1 since
+         a deeper search won't find longer ones
+       - binary data with short matches, as detect_data_type in trees.c sees it: level 6, level 9 chains
+         get long on it for a percent of ratio
+       - the rest, text and long matches: COMPRESSION_LEVEL with the default strategy */
+namespace DeflateStrategy
+{
+    struct Choice
+    {
+        bool m_isStored;
+        int m_level;
+        int m_strategy;
+    };
+
+    Choice choose(const uint8_t* data, size_t size);
+}
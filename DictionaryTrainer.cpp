@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "DictionaryTrainer.h"
+
+namespace
+{
+    /// k-mers are counted as 8 byte words, a segment is a few deflate matches long
+    const size_t KMER_SIZE = sizeof(uint64_t);
+    const size_t SEGMENT_SIZE = 256;
+    const size_t SEGMENT_KMERS_COUNT = SEGMENT_SIZE - KMER_SIZE + 1;
+
+    /// the k-mers are counted in a hashed table, a few collisions only blur the scores
+    const uint32_t FREQUENCIES_BITS = 22;
+
+    struct Segment
+    {
+        size_t m_start;
+        uint64_t m_score;
+    };
+
+    size_t kmerSlot(const uint8_t* data)
+    {
+        uint64_t kmer;
+        memcpy(&kmer, data, sizeof(kmer));
+
+        return static_cast<size_t>((kmer * 0x9E3779B97F4A7C15ull) >> (64 - FREQUENCIES_BITS));
+    }
+}
+
+std::vector<uint8_t> DictionaryTrainer::train(const std::vector<uint8_t>& samples, size_t dictionarySize)
+{
+    /// not enough data to choose from, the samples themselves are the best dictionary
+    if (samples.size() <= dictionarySize || dictionarySize < SEGMENT_SIZE)
+    {
+        return std::vector<uint8_t>(samples.end() - std::min(samples.size(), dictionarySize), samples.end());
+    }
+
+    std::vector<uint32_t> frequencies(size_t(1) << FREQUENCIES_BITS);
+    const size_t kmersCount = samples.size() - KMER_SIZE + 1;
+
+    for (size_t i = 0; i < kmersCount; ++i)
+    {
+        ++frequencies[kmerSlot(&samples[i])];
+    }
+
+    const size_t segmentsCount = dictionarySize / SEGMENT_SIZE;
+    const size_t epochSize = kmersCount / segmentsCount;
+    std::vector<Segment> segments;
+
+    for (size_t epochStart = 0; epochStart + SEGMENT_KMERS_COUNT <= kmersCount && segments.size() < segmentsCount; epochStart += epochSize)
+    {
+        size_t epochEnd = std::min(epochStart + epochSize, kmersCount);
+
+        if (epochEnd - epochStart < SEGMENT_KMERS_COUNT)
+        {
+            break;
+        }
+
+        /// slide a segment over the epoch, adding the k-mer entering it and removing the one leaving it
+        uint64_t score = 0;
+        for (size_t i = epochStart; i < epochStart + SEGMENT_KMERS_COUNT; ++i)
+        {
+            score += frequencies[kmerSlot(&samples[i])];
+        }
+
+        Segment best = { epochStart, score };
+
+        for (size_t start = epochStart + 1; start + SEGMENT_KMERS_COUNT <= epochEnd; ++start)
+        {
+            score += frequencies[kmerSlot(&samples[start + SEGMENT_KMERS_COUNT - 1])];
+            score -= frequencies[kmerSlot(&samples[start - 1])];
+
+            if (score > best.m_score)
+            {
+                best = { start, score };
+            }
+        }
+
+        if (best.m_score == 0)
+        {
+            continue;
+        }
+
+        /// what the dictionary already holds is worth nothing to the next segments
+        for (size_t i = best.m_start; i < best.m_start + SEGMENT_KMERS_COUNT; ++i)
+        {
+            frequencies[kmerSlot(&samples[i])] = 0;
+        }
+
+        segments.push_back(best);
+    }
+
+    std::stable_sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) { return a.m_score < b.m_score; });
+
+    std::vector<uint8_t> dictionary;
+    dictionary.reserve(segments.size() * SEGMENT_SIZE);
+
+    for (const Segment& segment : segments)
+    {
+        dictionary.insert(dictionary.end(), samples.begin() + segment.m_start, samples.begin() + segment.m_start + SEGMENT_SIZE);
+    }
+
+    return dictionary;
+}
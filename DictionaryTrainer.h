@@ -0,0 +1,14 @@
+#pragma once
+#include "pch.h"
+
+/* Builds a preset deflate dictionary out of sample chunks of the input, so a small chunk doesn't start its
+   stream with an empty window. Frequent substrings of the samples are picked the same way the zstd COVER
+   trainer does: the samples are split in as many epochs as the dictionary has segments, each epoch gives its
+   segment whose k-mers are the most frequent overall, and the k-mers of a picked segment stop counting so
+   the segments don't repeat each other. */
+namespace DictionaryTrainer
+{
+    /* a dictionary of at most dictionarySize bytes, the most useful segments last since deflate reaches the end
+       of the dictionary with the shortest distances */
+    std::vector<uint8_t> train(const std::vector<uint8_t>& samples, size_t dictionarySize);
+}
@@ -1,29 +1,227 @@
 #include "pch.h"
 #include "Fat.h"
 
-void Fat::writeToFile(LPCWSTR fatFilePath)
+Fat::Fat()
+    : m_fileSize(0)
+    , m_chunkSize(PAGE_SIZE)
+    , m_solidChunksCount(1)
+    , m_chunksOffsets(1, sizeof(ArchiveFormat::ArchiveHeader))   /// the first chunk comes right after the archive header and the dictionary
+    , m_fatOffset(0)
+    , m_assetIndexData(nullptr)
+    , m_assetIndexSize(0)
 {
-    ManagedHandle fatHandle = createWriteFile(fatFilePath);
+}
+
+void Fat::writeHeader(HANDLE archive) const
+{
+    ArchiveFormat::ArchiveHeader archiveHeader = header();
+
+    DWORD written;
+    throwIfFalse(WriteFile(archive, &archiveHeader, sizeof(archiveHeader), &written, nullptr));
+    throwIfFalse(WriteFile(archive, m_dictionary.data(), static_cast<DWORD>(m_dictionary.size()), &written, nullptr));
+}
+
+void Fat::setDictionary(std::vector<uint8_t> dictionary)
+{
+    throwIfFalse(m_chunksTypes.empty() && dictionary.size() <= ArchiveFormat::MAX_DICTIONARY_SIZE);
+
+    m_dictionary = std::move(dictionary);
+    m_chunksOffsets.front() = sizeof(ArchiveFormat::ArchiveHeader) + m_dictionary.size();
+}
+
+void Fat::addChunk(size_t compressedSize, ChunkType type, uint8_t parameter, ArchiveFormat::ChunkChecksums checksums)
+{
+    m_chunksOffsets.push_back(m_chunksOffsets.back() + compressedSize);
+    m_chunksTypes.push_back(type);
+    m_chunksParameters.push_back(parameter);
+    m_chunksChecksums.push_back(checksums);
+}
+
+void Fat::addReferenceChunk(size_t referencedChunk, ArchiveFormat::ChunkChecksums checksums)
+{
+    m_references.push_back({ m_chunksTypes.size(), referencedChunk });
+    addChunk(0, ChunkType::Reference, 0, checksums);
+}
+
+void Fat::setAssetIndex(std::vector<uint8_t> assetIndex)
+{
+    m_assetIndex = std::move(assetIndex);
+}
+
+void Fat::writeTrailer(HANDLE archive) const
+{
+    uint32_t deltaBits = ArchiveFormat::deltaBits(m_chunksOffsets.data(), m_chunksTypes.size());
+    throwIfFalse(deltaBits <= ArchiveFormat::MAX_DELTA_BITS);
+
+    ArchiveFormat::ArchiveFooter footer = {};
+    footer.m_header = header();
+    footer.m_fatOffset = m_chunksOffsets.back();
+    footer.m_fatSize = ArchiveFormat::fatSize(m_chunksTypes.size(), deltaBits, m_references.size());
+    footer.m_referencesCount = m_references.size();
+    footer.m_indexSize = m_assetIndex.size();
+    footer.m_deltaBits = deltaBits;
+    footer.m_magic = ArchiveFormat::FOOTER_MAGIC;
 
-    DWORD chunksCount = static_cast<DWORD>(m_chunksSizes.size());
+    std::vector<uint8_t> fat(static_cast<size_t>(footer.m_fatSize));
+    ArchiveFormat::encodeFat(m_chunksOffsets.data(), m_chunksTypes.data(), m_chunksParameters.data(), m_chunksChecksums.data(), m_chunksTypes.size(),
+        m_references.data(), m_references.size(), deltaBits, fat.data());
 
-    throwIfFalse(WriteFile(fatHandle.get(), &m_fileSize, sizeof(m_fileSize), nullptr, nullptr));
-    throwIfFalse(WriteFile(fatHandle.get(), &chunksCount, sizeof(chunksCount), nullptr, nullptr));
-    throwIfFalse(WriteFile(fatHandle.get(), m_chunksSizes.data(), chunksCount * sizeof(size_t), nullptr, nullptr));
+    DWORD written;
+    throwIfFalse(WriteFile(archive, fat.data(), static_cast<DWORD>(fat.size()), &written, nullptr));
+    throwIfFalse(WriteFile(archive, m_assetIndex.data(), static_cast<DWORD>(m_assetIndex.size()), &written, nullptr));
+    throwIfFalse(WriteFile(archive, &footer, sizeof(footer), &written, nullptr));
 }
 
-void Fat::readFromFile(LPCWSTR fatFilePath)
+void Fat::readFromArchive(LPCWSTR archivePath)
 {
-    ManagedHandle fatHandle = createReadFile(fatFilePath);
-    
-    DWORD chunksCount = 0;
+    ManagedHandle archive = createReadFile(archivePath);
+    size_t archiveSize = fileSize(archive.get()).QuadPart;
+
+    throwIfFalse(archiveSize >= sizeof(ArchiveFormat::ArchiveHeader) + sizeof(ArchiveFormat::ArchiveFooter));
+
+    ArchiveFormat::ArchiveFooter footer;
+    LARGE_INTEGER offset;
+    offset.QuadPart = archiveSize - sizeof(footer);
 
     DWORD readCount;
-    throwIfFalse(ReadFile(fatHandle.get(), &m_fileSize, sizeof(m_fileSize), &readCount, nullptr));
-    throwIfFalse(ReadFile(fatHandle.get(), &chunksCount, sizeof(chunksCount), &readCount, nullptr));
+    throwIfFalse(SetFilePointerEx(archive.get(), offset, nullptr, FILE_BEGIN));
+    throwIfFalse(ReadFile(archive.get(), &footer, sizeof(footer), &readCount, nullptr));
+    throwIfFalse(readCount == sizeof(footer));
+
+    throwIfFalse(ArchiveFormat::isValid(footer, archiveSize));
+    throwIfFalse(footer.m_header.m_chunkSize >= MIN_CHUNK_SIZE && footer.m_header.m_chunkSize <= MAX_CHUNK_SIZE);
+
+    m_dictionary.resize(footer.m_header.m_dictionarySize);
+    offset.QuadPart = sizeof(ArchiveFormat::ArchiveHeader);
+
+    throwIfFalse(SetFilePointerEx(archive.get(), offset, nullptr, FILE_BEGIN));
+    throwIfFalse(ReadFile(archive.get(), m_dictionary.data(), static_cast<DWORD>(m_dictionary.size()), &readCount, nullptr));
+    throwIfFalse(readCount == m_dictionary.size());
+
+    /// the view keeps the mapping alive once the file and mapping handles are closed
+    LARGE_INTEGER mapOffset;
+    mapOffset.QuadPart = alignDown(static_cast<size_t>(footer.m_fatOffset), ALLOCATION_GRANULARITY);
+
+    ManagedHandle mapping = createReadFileMapping(archive.get(), archiveSize);
+    m_fatMapping = createReadMapViewOfFile(mapping.get(), mapOffset, archiveSize - mapOffset.QuadPart);
+
+    const uint8_t* fat = reinterpret_cast<const uint8_t*>(m_fatMapping.get()) + (footer.m_fatOffset - mapOffset.QuadPart);
+
+    m_fat = ArchiveFormat::FatView(fat, footer.m_header.m_chunksCount, footer.m_deltaBits, footer.m_referencesCount);
+    m_fatOffset = static_cast<size_t>(footer.m_fatOffset);
+    m_assetIndexData = fat + footer.m_fatSize;
+    m_assetIndexSize = static_cast<size_t>(footer.m_indexSize);
+    m_fileSize = static_cast<size_t>(footer.m_header.m_originalFileSize);
+    m_chunkSize = footer.m_header.m_chunkSize;
+    m_solidChunksCount = footer.m_header.m_solidChunksCount;
+
+    /// the chunks have to lie between the dictionary and the FAT, the offsets in between get checked on lookup
+    throwIfFalse(m_fat.chunkOffset(0) == sizeof(ArchiveFormat::ArchiveHeader) + m_dictionary.size() && m_fat.chunkOffset(chunksCount()) == m_fatOffset);
+}
+
+ArchiveFormat::ArchiveHeader Fat::header() const
+{
+    ArchiveFormat::ArchiveHeader archiveHeader = {};
+    archiveHeader.m_magic = ArchiveFormat::HEADER_MAGIC;
+    archiveHeader.m_version = ArchiveFormat::VERSION;
+    archiveHeader.m_codec = ArchiveFormat::CODEC_ZLIB;
+    archiveHeader.m_chunkSize = static_cast<uint32_t>(m_chunkSize);
+    archiveHeader.m_solidChunksCount = static_cast<uint32_t>(m_solidChunksCount);
+    archiveHeader.m_dictionarySize = static_cast<uint32_t>(m_dictionary.size());
+    archiveHeader.m_flags = m_assetIndex.empty() ? 0 : ArchiveFormat::FLAG_ASSET_INDEX;
+    archiveHeader.m_originalFileSize = m_fileSize;
+    archiveHeader.m_chunksCount = ArchiveFormat::chunksCount(m_fileSize, archiveHeader.m_chunkSize);
+
+    return archiveHeader;
+}
+
+size_t Fat::chunksCount() const
+{
+    return static_cast<size_t>(m_fat.m_chunksCount);
+}
+
+size_t Fat::chunkOffset(size_t chunkIndex) const
+{
+    size_t offset = static_cast<size_t>(m_fat.chunkOffset(chunkIndex));
+
+    /// a corrupted delta must not send a reader past the payloads
+    throwIfFalse(offset <= m_fatOffset);
 
-    assert(chunksCount > 0);
-    m_chunksSizes.resize(chunksCount);
+    return offset;
+}
+
+size_t Fat::compressedChunkSize(size_t chunkIndex) const
+{
+    size_t start = chunkOffset(chunkIndex);
+    size_t end = chunkOffset(chunkIndex + 1);
+
+    throwIfFalse(start <= end);
+
+    return end - start;
+}
+
+ChunkType Fat::chunkType(size_t chunkIndex) const
+{
+    return m_fat.chunkType(chunkIndex);
+}
+
+uint8_t Fat::chunkParameter(size_t chunkIndex) const
+{
+    return m_fat.chunkParameter(chunkIndex);
+}
+
+ArchiveFormat::ChunkChecksums Fat::chunkChecksums(size_t chunkIndex) const
+{
+    return m_fat.chunkChecksums(chunkIndex);
+}
+
+size_t Fat::referencedChunk(size_t chunkIndex) const
+{
+    uint64_t referencedChunk;
+    throwIfFalse(chunkType(chunkIndex) == ChunkType::Reference && m_fat.referencedChunk(chunkIndex, referencedChunk));
+
+    /// references only go back to chunks holding a payload, so they never chain
+    throwIfFalse(referencedChunk < chunkIndex);
+
+    ChunkType referencedType = chunkType(static_cast<size_t>(referencedChunk));
+    throwIfFalse(referencedType == ChunkType::Deflated || referencedType == ChunkType::Stored || referencedType == ChunkType::Solid);
+
+    return static_cast<size_t>(referencedChunk);
+}
 
-    throwIfFalse(ReadFile(fatHandle.get(), m_chunksSizes.data(), chunksCount * sizeof(size_t), &readCount, nullptr));
-}
\ No newline at end of file
+size_t Fat::referencesCount() const
+{
+    return static_cast<size_t>(m_fat.m_referencesCount);
+}
+
+ArchiveFormat::ChunkReference Fat::reference(size_t referenceIndex) const
+{
+    return m_fat.reference(referenceIndex);
+}
+
+const std::vector<uint8_t>& Fat::dictionary() const
+{
+    return m_dictionary;
+}
+
+const uint8_t* Fat::assetIndexData() const
+{
+    return m_assetIndexData;
+}
+
+size_t Fat::assetIndexSize() const
+{
+    return m_assetIndexSize;
+}
+
+size_t Fat::chunkDecompressedSize(size_t chunkIndex) const
+{
+    size_t chunkStart = chunkIndex * m_chunkSize;
+
+    return std::min(m_chunkSize, m_fileSize - chunkStart);
+}
+
+size_t Fat::solidGroupStart(size_t chunkIndex) const
+{
+    return chunkIndex - chunkIndex % m_solidChunksCount;
+}
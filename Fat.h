@@ -1,11 +1,91 @@
 #pragma once
 #include "pch.h"
+#include "ArchiveFormat.h"
 
-struct Fat
+/* The chunks table of an archive. addChunk and writeTrailer build the FAT of a new archive, readFromArchive
+   maps the FAT of an existing one so opening an archive costs a footer read whatever its size. */
+class Fat
 {
-    void writeToFile(LPCWSTR fatFilePath);
-    void readFromFile(LPCWSTR fatFilePath);
+public:
+    Fat();
+
+    /* the preset dictionary of the chunks, written after the header, set before the first chunk */
+    void setDictionary(std::vector<uint8_t> dictionary);
+
+    /* the archive header and the dictionary, written before the first chunk */
+    void writeHeader(HANDLE archive) const;
+
+    /* the chunk written right after the previous one */
+    void addChunk(size_t compressedSize, ChunkType type, uint8_t parameter, ArchiveFormat::ChunkChecksums checksums);
+
+    /* a chunk with the same bytes as the earlier chunk referencedChunk, it takes no room in the archive */
+    void addReferenceChunk(size_t referencedChunk, ArchiveFormat::ChunkChecksums checksums);
+
+    /* the serialized AssetIndex of a pack, written after the FAT */
+    void setAssetIndex(std::vector<uint8_t> assetIndex);
+
+    /* the FAT, the asset index and the footer, appended after the last chunk */
+    void writeTrailer(HANDLE archive) const;
+
+    /* validates the footer of the archive and maps its FAT, the FAT pages are read on first lookup */
+    void readFromArchive(LPCWSTR archivePath);
+
+    ArchiveFormat::ArchiveHeader header() const;
+
+    size_t chunksCount() const;
+
+    /* absolute offset of the chunk in the archive, chunkIndex == chunksCount() gives the end of the last chunk */
+    size_t chunkOffset(size_t chunkIndex) const;
+
+    size_t compressedChunkSize(size_t chunkIndex) const;
+
+    ChunkType chunkType(size_t chunkIndex) const;
+
+    /* the fill byte of Fill chunks */
+    uint8_t chunkParameter(size_t chunkIndex) const;
+
+    ArchiveFormat::ChunkChecksums chunkChecksums(size_t chunkIndex) const;
+
+    /* the chunk holding the bytes of the Reference chunk chunkIndex, throws if the reference is broken */
+    size_t referencedChunk(size_t chunkIndex) const;
+
+    /* the references sorted by chunk index, to know up front which chunks are shared */
+    size_t referencesCount() const;
+    ArchiveFormat::ChunkReference reference(size_t referenceIndex) const;
+
+    /* the preset dictionary of the chunks, empty when they don't have one */
+    const std::vector<uint8_t>& dictionary() const;
+
+    /* the asset index of a pack, mapped with the FAT, empty for a single file archive */
+    const uint8_t* assetIndexData() const;
+    size_t assetIndexSize() const;
+
+    /* size of chunk chunkIndex once decompressed, only the last chunk may be smaller than m_chunkSize */
+    size_t chunkDecompressedSize(size_t chunkIndex) const;
+
+    /* first chunk of the solid group of chunkIndex */
+    size_t solidGroupStart(size_t chunkIndex) const;
 
-    std::vector<size_t> m_chunksSizes;
     size_t m_fileSize;
+    size_t m_chunkSize;
+    size_t m_solidChunksCount;
+
+private:
+    /// FAT of the archive being written
+    std::vector<uint64_t> m_chunksOffsets;
+    std::vector<ChunkType> m_chunksTypes;
+    std::vector<uint8_t> m_chunksParameters;
+    std::vector<ArchiveFormat::ChunkChecksums> m_chunksChecksums;
+    std::vector<ArchiveFormat::ChunkReference> m_references;
+    std::vector<uint8_t> m_assetIndex;
+
+    /// read along with the footer, written with the header
+    std::vector<uint8_t> m_dictionary;
+
+    /// FAT of the archive being read, looked up in place in the mapped archive
+    ManagedViewHandle m_fatMapping;
+    ArchiveFormat::FatView m_fat;
+    size_t m_fatOffset;
+    const uint8_t* m_assetIndexData;
+    size_t m_assetIndexSize;
 };
@@ -0,0 +1,181 @@
+#include "pch.h"
+#include "GzipCompressor.h"
+#include "ZStreamPool.h"
+#include "Parallelism.h"
+
+namespace
+{
+    /// how far back deflate looks, the dictionary that primes a block
+    const size_t DEFLATE_WINDOW_SIZE = 32 * 1024;
+
+    /// gzip header fields (RFC 1952)
+    const uint8_t GZIP_ID1 = 0x1f;
+    const uint8_t GZIP_ID2 = 0x8b;
+    const uint8_t GZIP_CM_DEFLATE = 8;
+    const uint8_t GZIP_XFL_SLOWEST = 2;
+    const uint8_t GZIP_XFL_FASTEST = 4;
+    const uint8_t GZIP_OS_NTFS = 11;
+
+    void writeBytes(HANDLE outputFile, const void* data, size_t size)
+    {
+        DWORD written;
+        throwIfFalse(WriteFile(outputFile, data, static_cast<DWORD>(size), &written, nullptr) && written == size);
+    }
+
+    /* gzip stores its integers little endian */
+    void storeUint32(uint8_t* dest, uint32_t value)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            dest[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+}
+
+GzipCompressor::GzipCompressor(size_t blockSize, int level)
+    : m_blockSize(blockSize)
+    , m_level(level)
+{
+    /// the input windows have to split evenly into blocks
+    throwIfFalse(blockSize >= MIN_CHUNK_SIZE && blockSize <= MAX_CHUNK_SIZE && isAligned(INPUT_WINDOW_SIZE, blockSize));
+    throwIfFalse(level >= 1 && level <= 9);
+}
+
+void GzipCompressor::compress(LPCWSTR inputFilePath, LPCWSTR outputFilePath)
+{
+    DeleteFile(outputFilePath);
+    ManagedHandle outputFile = createWriteFile(outputFilePath);
+
+    /// one worker per core by default, the writer parks at most a few blocks per worker behind a slow one
+    const size_t workersCount = Parallelism::workersCount();
+    BlockPipeline pipeline(workersCount, 4 * workersCount);
+
+    uLong crc = crc32(0, Z_NULL, 0);
+    size_t inputSize = 0;
+
+    writeHeader(outputFile.get());
+
+    pipeline.run(
+        [&] { readBlocks(inputFilePath, pipeline); },
+        [&] { compressBlocks(pipeline); },
+        [&](BlockTask& blockTask) { writeBlock(blockTask, outputFile.get(), crc, inputSize); });
+
+    writeTrailer(outputFile.get(), crc, inputSize);
+}
+
+void GzipCompressor::readBlocks(LPCWSTR inputFilePath, BlockPipeline& pipeline)
+{
+    ManagedHandle inputFile = createReadFile(inputFilePath);
+    const size_t bigFileSize = fileSize(inputFile.get()).QuadPart;
+
+    /// an empty file can't be mapped, it still takes the one last block that ends the deflate stream
+    if (bigFileSize == 0)
+    {
+        pipeline.push({ 0, nullptr, 0, 0, true, nullptr }, 1);
+        return;
+    }
+
+    ManagedHandle fileMapping = createReadFileMapping(inputFile.get(), 0);
+    size_t blockIndex = 0;
+
+    for (size_t windowStart = 0; windowStart < bigFileSize; windowStart += INPUT_WINDOW_SIZE)
+    {
+        /// map from an allocation granularity earlier too, so the first block of the window has its dictionary
+        const size_t leadSize = windowStart == 0 ? 0 : ALLOCATION_GRANULARITY;
+        static_assert(ALLOCATION_GRANULARITY >= DEFLATE_WINDOW_SIZE, "the lead has to cover the dictionary");
+
+        LARGE_INTEGER offset;
+        offset.QuadPart = windowStart - leadSize;
+
+        size_t windowSize = std::min(INPUT_WINDOW_SIZE, bigFileSize - windowStart);
+        std::shared_ptr<void> window = createReadMapViewOfFile(fileMapping.get(), offset, leadSize + windowSize);
+        const uint8_t* windowData = reinterpret_cast<const uint8_t*>(window.get()) + leadSize;
+
+        for (size_t blockStart = 0; blockStart < windowSize; blockStart += m_blockSize)
+        {
+            size_t blockSize = std::min(m_blockSize, windowSize - blockStart);
+            size_t dictionarySize = std::min(DEFLATE_WINDOW_SIZE, windowStart + blockStart);
+            bool isLast = windowStart + blockStart + blockSize == bigFileSize;
+
+            if (!pipeline.push({ blockIndex, windowData + blockStart, blockSize, dictionarySize, isLast, window }, blockIndex + 1))
+            {
+                return;
+            }
+
+            ++blockIndex;
+        }
+    }
+}
+
+void GzipCompressor::compressBlocks(BlockPipeline& pipeline)
+{
+    BlockView view;
+
+    while (pipeline.pop(view))
+    {
+        BlockTask task;
+        task.m_index = view.m_index;
+        task.m_size = view.m_size;
+        task.m_crc = crc32(crc32(0, Z_NULL, 0), view.m_data, static_cast<uInt>(view.m_size));
+        task.m_block = zlibCompressBlock(view);
+
+        /// let go of the window as soon as possible so it can be unmapped
+        view.m_window.reset();
+
+        if (!pipeline.emit(std::move(task)))
+        {
+            return;
+        }
+    }
+}
+
+void GzipCompressor::writeBlock(const BlockTask& blockTask, HANDLE outputFile, uLong& crc, size_t& inputSize)
+{
+    crc = crc32_combine(crc, blockTask.m_crc, static_cast<z_off_t>(blockTask.m_size));
+    inputSize += blockTask.m_size;
+
+    writeBytes(outputFile, blockTask.m_block->m_memory.get(), blockTask.m_block->chunkSize);
+}
+
+void GzipCompressor::writeHeader(HANDLE outputFile)
+{
+    uint8_t header[10] = { GZIP_ID1, GZIP_ID2, GZIP_CM_DEFLATE, 0, 0, 0, 0, 0, 0, GZIP_OS_NTFS };
+    header[8] = m_level == 9 ? GZIP_XFL_SLOWEST : (m_level == 1 ? GZIP_XFL_FASTEST : 0);
+    writeBytes(outputFile, header, sizeof(header));
+}
+
+void GzipCompressor::writeTrailer(HANDLE outputFile, uLong crc, size_t inputSize)
+{
+    /// the size is only kept modulo 2^32
+    uint8_t trailer[8];
+    storeUint32(trailer, static_cast<uint32_t>(crc));
+    storeUint32(trailer + 4, static_cast<uint32_t>(inputSize));
+    writeBytes(outputFile, trailer, sizeof(trailer));
+}
+
+std::unique_ptr<Chunk> GzipCompressor::zlibCompressBlock(const BlockView& view)
+{
+    ZStreamPool::Stream pooledStream = ZStreamPool::acquireDeflate(m_level, -MAX_WBITS);
+    z_stream& stream = pooledStream->m_stream;
+
+    if (view.m_dictionarySize != 0)
+    {
+        throwIfFalse(deflateSetDictionary(&stream, view.m_data - view.m_dictionarySize, static_cast<uInt>(view.m_dictionarySize)) == Z_OK);
+    }
+
+    /// the bound of a whole stream plus the empty stored block of the sync flush
+    size_t destBytesCount = deflateBound(&stream, static_cast<uLong>(view.m_size)) + 16;
+    auto dest = std::make_unique<Chunk>(destBytesCount);
+
+    stream.avail_in = static_cast<uInt>(view.m_size);
+    stream.next_in = const_cast<Bytef*>(view.m_data);
+    stream.avail_out = static_cast<uInt>(destBytesCount);
+    stream.next_out = reinterpret_cast<Bytef*>(dest->m_memory.get());
+
+    /// the sync flush ends the block on a byte boundary without a final block, only the last block ends the stream
+    int ret = deflate(&stream, view.m_isLast ? Z_FINISH : Z_SYNC_FLUSH);
+    throwIfFalse((view.m_isLast ? ret == Z_STREAM_END : ret == Z_OK) && stream.avail_in == 0 && stream.avail_out != 0);
+
+    dest->chunkSize = destBytesCount - stream.avail_out;
+    return dest;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "Pipeline.h"
+
+/* Writes a standard single member .gz that any gunzip reads, deflated on every core the way pigz does it. The
+   input is cut into blocks, each block is deflated on its own raw stream primed with the 32 KB before it through
+   deflateSetDictionary, so matches still reach across blocks, and ends on a sync flush so the blocks simply follow
+   each other in the output. The writer merges the CRC32 of the blocks with crc32_combine into the trailer. */
+class GzipCompressor
+{
+    /* a block of the input file viewed in place, m_window keeps the mapped view alive and also maps the
+       window before m_data that primes its stream */
+    struct BlockView
+    {
+        size_t m_index;
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_dictionarySize;
+        bool m_isLast;
+        std::shared_ptr<void> m_window;
+    };
+
+    /* a deflated block on its way to the writer, m_crc is the CRC32 of its m_size input bytes */
+    struct BlockTask
+    {
+        BlockTask() : m_index(0), m_size(0), m_crc(0) {}
+
+        size_t m_index;
+        size_t m_size;
+        uLong m_crc;
+        std::unique_ptr<Chunk> m_block;
+    };
+
+    using BlockPipeline = Pipeline<BlockView, BlockTask>;
+
+public:
+    /* blockSize is the unit of work of a worker, a power of two in [MIN_CHUNK_SIZE, MAX_CHUNK_SIZE], level the deflate level */
+    GzipCompressor(size_t blockSize = GZIP_BLOCK_SIZE, int level = COMPRESSION_LEVEL);
+
+    void compress(LPCWSTR inputFilePath, LPCWSTR outputFilePath);
+
+private:
+    /* pipeline stages, they all run at the same time, the writer gets the blocks in order one at a time and
+       adds each to the crc and the size of the input */
+    void readBlocks(LPCWSTR inputFilePath, BlockPipeline& pipeline);
+
+    void compressBlocks(BlockPipeline& pipeline);
+
+    void writeBlock(const BlockTask& blockTask, HANDLE outputFile, uLong& crc, size_t& inputSize);
+
+    void writeHeader(HANDLE outputFile);
+
+    void writeTrailer(HANDLE outputFile, uLong crc, size_t inputSize);
+
+    /* deflate a block as the next part of the raw deflate stream of the member, up to a sync flush or to the end of the stream */
+    std::unique_ptr<Chunk> zlibCompressBlock(const BlockView& view);
+
+    size_t m_blockSize;
+    int m_level;
+};
@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "MurmurHash3.h"
+
+namespace
+{
+    const uint64_t C1 = 0x87C37B91114253D5ULL;
+    const uint64_t C2 = 0x4CF5AD432745937FULL;
+
+    uint64_t rotl64(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xFF51AFD7ED558CCDULL;
+        k ^= k >> 33;
+        k *= 0xC4CEB9FE1A85EC53ULL;
+        k ^= k >> 33;
+
+        return k;
+    }
+}
+
+MurmurHash3::Hash128 MurmurHash3::hash128(const void* data, size_t size, uint32_t seed)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    const size_t blocksCount = size / 16;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    for (size_t i = 0; i < blocksCount; ++i)
+    {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i * 16, sizeof(k1));
+        memcpy(&k2, bytes + i * 16 + 8, sizeof(k2));
+
+        k1 *= C1; k1 = rotl64(k1, 31); k1 *= C2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= C2; k2 = rotl64(k2, 33); k2 *= C1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    /// the last 0 to 15 bytes
+    const uint8_t* tail = bytes + blocksCount * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (size & 15)
+    {
+    case 15: k2 ^= uint64_t(tail[14]) << 48;
+    case 14: k2 ^= uint64_t(tail[13]) << 40;
+    case 13: k2 ^= uint64_t(tail[12]) << 32;
+    case 12: k2 ^= uint64_t(tail[11]) << 24;
+    case 11: k2 ^= uint64_t(tail[10]) << 16;
+    case 10: k2 ^= uint64_t(tail[9]) << 8;
+    case 9:  k2 ^= uint64_t(tail[8]);
+             k2 *= C2; k2 = rotl64(k2, 33); k2 *= C1; h2 ^= k2;
+
+    case 8:  k1 ^= uint64_t(tail[7]) << 56;
+    case 7:  k1 ^= uint64_t(tail[6]) << 48;
+    case 6:  k1 ^= uint64_t(tail[5]) << 40;
+    case 5:  k1 ^= uint64_t(tail[4]) << 32;
+    case 4:  k1 ^= uint64_t(tail[3]) << 24;
+    case 3:  k1 ^= uint64_t(tail[2]) << 16;
+    case 2:  k1 ^= uint64_t(tail[1]) << 8;
+    case 1:  k1 ^= uint64_t(tail[0]);
+             k1 *= C1; k1 = rotl64(k1, 31); k1 *= C2; h1 ^= k1;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return { h1, h2 };
+}
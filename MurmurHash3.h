@@ -0,0 +1,28 @@
+#pragma once
+#include "pch.h"
+
+/* MurmurHash3 x64 128 bit, fast enough to key every chunk of the archive by its content */
+namespace MurmurHash3
+{
+    struct Hash128
+    {
+        bool operator==(const Hash128& other) const
+        {
+            return m_low == other.m_low && m_high == other.m_high;
+        }
+
+        uint64_t m_low;
+        uint64_t m_high;
+    };
+
+    /* for unordered containers, the hash bits are already well mixed */
+    struct Hash128Hasher
+    {
+        size_t operator()(const Hash128& hash) const
+        {
+            return static_cast<size_t>(hash.m_low);
+        }
+    };
+
+    Hash128 hash128(const void* data, size_t size, uint32_t seed = 0);
+}
@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "Parallelism.h"
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    /// chunks per worker and batch, so a worker done early with an easy chunk finds another one
+    const size_t CHUNKS_PER_WORKER = 4;
+
+    /// a batch is at least that big so the barrier between batches stays cheap on few cores
+    const size_t MIN_BATCH_SIZE = 4 * 1024 * 1024;
+
+    /// the decompressed chunks of a batch take at most this share of the memory free at startup
+    const size_t BATCH_MEMORY_SHARE = 8;
+
+    std::atomic<size_t> workersCountOverride(0);
+    std::atomic<size_t> batchChunksCountOverride(0);
+
+    size_t availableMemory()
+    {
+        static const size_t memory = []
+        {
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof(status);
+
+            /// without the figure assume just enough for the smallest batch
+            return GlobalMemoryStatusEx(&status) ? static_cast<size_t>(status.ullAvailPhys) : MIN_BATCH_SIZE * BATCH_MEMORY_SHARE;
+        }();
+
+        return memory;
+    }
+}
+
+size_t Parallelism::workersCount()
+{
+    size_t workersCount = workersCountOverride;
+
+    return workersCount != 0 ? workersCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+size_t Parallelism::batchChunksCount(size_t chunkSize, size_t solidChunksCount)
+{
+    size_t chunksCount = batchChunksCountOverride;
+
+    if (chunksCount == 0)
+    {
+        /// a worker inflates a whole solid group at a time
+        chunksCount = std::max(workersCount() * CHUNKS_PER_WORKER * solidChunksCount, MIN_BATCH_SIZE / chunkSize);
+        chunksCount = std::min(chunksCount, availableMemory() / BATCH_MEMORY_SHARE / chunkSize);
+    }
+
+    /// a group can't be inflated from the middle, so at least one whole group whatever the memory
+    return align(std::max<size_t>(chunksCount, 1), solidChunksCount);
+}
+
+void Parallelism::setWorkersCount(size_t workersCount)
+{
+    workersCountOverride = workersCount;
+}
+
+void Parallelism::setBatchChunksCount(size_t batchChunksCount)
+{
+    batchChunksCountOverride = batchChunksCount;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "pch.h"
+
+/* How much work the pipelines keep in flight. By default there is one worker per core, and a decompression batch
+   gives every worker a few chunks while its decompressed size stays a small share of the memory that was free at
+   startup, so a many core machine doesn't wait on the batch barrier every few chunks and a small one doesn't page.
+   Both can be overridden, for the scaling benchmark or for a machine shared with other jobs. */
+namespace Parallelism
+{
+    /* the compression workers, one per core unless overridden */
+    size_t workersCount();
+
+    /* chunks of chunkSize bytes inflated per parallel batch, whole solid groups of solidChunksCount chunks */
+    size_t batchChunksCount(size_t chunkSize, size_t solidChunksCount);
+
+    /* 0 goes back to the automatic value */
+    void setWorkersCount(size_t workersCount);
+
+    /* 0 goes back to the automatic value, a batch is still rounded up to whole solid groups */
+    void setBatchChunksCount(size_t batchChunksCount);
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "BoundedQueue.h"
+#include "ReorderWindow.h"
+#include <exception>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+
+/* The read, compress and write stages of the compressors. One thread reads the input in order and pushes items,
+   workersCount threads pop the items and emit tasks, and the calling thread writes the tasks in the order of
+   their m_index, parking the ones that come early. The bounded queues and the reorder window keep what is in
+   flight bounded even when one item takes much longer than the others */
+template <typename Item, typename Task>
+class Pipeline
+{
+public:
+    /* reorderWindowSize is how many tasks past the next one to write can be in flight */
+    Pipeline(size_t workersCount, size_t reorderWindowSize)
+        : m_workersCount(workersCount)
+        , m_items(2 * workersCount)
+        , m_tasks(2 * workersCount)
+        , m_reorderWindow(reorderWindowSize)
+    {
+    }
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /* from the reader, the item gives the tasks before endIndex. Blocks until they fit in the reorder window and
+       the item in the queue, returns false once the pipeline stopped */
+    bool push(Item&& item, size_t endIndex)
+    {
+        return m_reorderWindow.waitFor(endIndex) && m_items.push(std::move(item));
+    }
+
+    /* from a worker, returns false once the reader is done and every item is taken */
+    bool pop(Item& item)
+    {
+        return m_items.pop(item);
+    }
+
+    /* from a worker, returns false once the pipeline stopped */
+    bool emit(Task&& task)
+    {
+        return m_tasks.push(std::move(task));
+    }
+
+    /* runs read on its own thread, work on each worker and write on the calling thread for every task in order.
+       The first stage that throws stops the others, its exception is rethrown once they are all done */
+    void run(const std::function<void()>& read, const std::function<void()>& work, const std::function<void(Task&)>& write)
+    {
+        std::mutex errorMutex;
+        std::exception_ptr error;
+
+        /// remember the first failure and shut the pipeline down so no stage blocks forever
+        auto runStage = [&](const std::function<void()>& stage)
+        {
+            try
+            {
+                stage();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+
+                m_items.close();
+                m_tasks.close();
+                m_reorderWindow.close();
+            }
+        };
+
+        std::thread reader([&]
+        {
+            runStage(read);
+            m_items.close();
+        });
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < m_workersCount; ++i)
+        {
+            workers.emplace_back([&]
+            {
+                runStage(work);
+            });
+        }
+
+        /// the writer stops once every worker is done
+        std::thread workersJoiner([&]
+        {
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+
+            m_tasks.close();
+        });
+
+        runStage([&] { writeInOrder(write); });
+
+        reader.join();
+        workersJoiner.join();
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void writeInOrder(const std::function<void(Task&)>& write)
+    {
+        /// workers finish out of order, park the early tasks until their turn comes
+        std::map<size_t, Task> pendingTasks;
+        size_t nextIndex = 0;
+
+        Task task;
+
+        while (m_tasks.pop(task))
+        {
+            pendingTasks.emplace(task.m_index, std::move(task));
+
+            for (auto it = pendingTasks.find(nextIndex); it != pendingTasks.end(); it = pendingTasks.find(++nextIndex))
+            {
+                write(it->second);
+                pendingTasks.erase(it);
+            }
+
+            m_reorderWindow.advance(nextIndex);
+        }
+    }
+
+    size_t m_workersCount;
+    BoundedQueue<Item> m_items;
+    BoundedQueue<Task> m_tasks;
+    ReorderWindow m_reorderWindow;
+};
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "Prefetcher.h"
+#include "Parallelism.h"
+
+namespace
+{
+    /// reads in a row that have to follow the same walk before the next ones are read ahead
+    const size_t MIN_STREAK = 2;
+
+    /// how many reads of a strided walk are read ahead
+    const size_t PREFETCH_DEPTH = 4;
+
+    /// how much of the archive a sequential walk keeps read ahead, more than a page of the page cache
+    const size_t PREFETCH_DISTANCE = 8 * 1024 * 1024;
+
+    /// past that many pending parts the reader is ahead of the prefetcher, the oldest parts are of no use anymore
+    const size_t MAX_PENDING_READS_COUNT = 4 * PREFETCH_DEPTH;
+}
+
+Prefetcher::Prefetcher(CompressedFileMap& compressedFileMap, const Fat& fat)
+    : m_compressedFileMap(compressedFileMap)
+    , m_fat(fat)
+    , m_isStopped(false)
+    , m_lastFirstChunk(0)
+    , m_lastEndChunk(0)
+    , m_stride(0)
+    , m_streak(0)
+    , m_prefetchedEndChunk(0)
+    , m_thread([this] { run(); })
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopped = true;
+    }
+
+    m_wakeUp.notify_one();
+    m_thread.join();
+}
+
+void Prefetcher::onRead(size_t firstChunk, size_t endChunk)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    /// small reads come back to the same chunks, they neither continue nor break the walk
+    if (firstChunk == m_lastFirstChunk && endChunk == m_lastEndChunk)
+    {
+        return;
+    }
+
+    /// a read that goes on where the last one ended is sequential whatever its length, otherwise it has to keep the stride
+    bool isSequential = firstChunk >= m_lastFirstChunk && firstChunk <= m_lastEndChunk && endChunk > m_lastEndChunk;
+    /// a read going back starts no walk, its stride is 0 so the next one can't continue it either
+    size_t stride = isSequential ? endChunk - firstChunk : (firstChunk > m_lastFirstChunk ? firstChunk - m_lastFirstChunk : 0);
+
+    m_streak = isSequential || (stride != 0 && stride == m_stride) ? m_streak + 1 : 0;
+
+    /// a walk with short steps goes through every page anyway, it reads ahead the whole way like a sequential one
+    bool isDense = isSequential || (m_streak != 0 && m_fat.chunkOffset(firstChunk) - m_fat.chunkOffset(m_lastFirstChunk) <= PREFETCH_DISTANCE / PREFETCH_DEPTH);
+
+    /// a new walk may go over chunks an old one already read ahead, long evicted since
+    if (m_streak == 0)
+    {
+        m_prefetchedEndChunk = 0;
+    }
+
+    m_stride = stride;
+    m_lastFirstChunk = firstChunk;
+    m_lastEndChunk = endChunk;
+
+    if (m_streak < MIN_STREAK)
+    {
+        return;
+    }
+
+    if (isDense)
+    {
+        /// small reads would read ahead next to nothing each, keep a distance ahead instead and top it up once half of it is read
+        if (m_prefetchedEndChunk > endChunk && m_fat.chunkOffset(m_prefetchedEndChunk) - m_fat.chunkOffset(endChunk) >= PREFETCH_DISTANCE / 2)
+        {
+            return;
+        }
+
+        size_t aheadEndChunk = chunkAtDistance(endChunk, PREFETCH_DISTANCE);
+        size_t aheadFirstChunk = std::max(endChunk, m_prefetchedEndChunk);
+
+        if (aheadFirstChunk < aheadEndChunk)
+        {
+            enqueue(aheadFirstChunk, aheadEndChunk);
+            m_prefetchedEndChunk = aheadEndChunk;
+            m_wakeUp.notify_one();
+        }
+
+        return;
+    }
+
+    for (size_t step = 1; step <= PREFETCH_DEPTH; ++step)
+    {
+        size_t nextFirstChunk = firstChunk + step * stride;
+
+        if (nextFirstChunk >= m_fat.chunksCount())
+        {
+            break;
+        }
+
+        if (nextFirstChunk >= m_prefetchedEndChunk)
+        {
+            enqueue(nextFirstChunk, std::min(nextFirstChunk + (endChunk - firstChunk), m_fat.chunksCount()));
+            m_prefetchedEndChunk = nextFirstChunk + 1;
+        }
+    }
+
+    m_wakeUp.notify_one();
+}
+
+void Prefetcher::prefetch(size_t firstChunk, size_t endChunk)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        enqueue(firstChunk, std::min(endChunk, m_fat.chunksCount()));
+    }
+
+    m_wakeUp.notify_one();
+}
+
+void Prefetcher::enqueue(size_t firstChunk, size_t endChunk)
+{
+    /// the same batches as the readers, which start from the solid group of their first chunk
+    const size_t batchChunksCount = Parallelism::batchChunksCount(m_fat.m_chunkSize, m_fat.m_solidChunksCount);
+
+    const size_t firstBatchStart = m_fat.solidGroupStart(firstChunk);
+
+    if (firstBatchStart >= endChunk)
+    {
+        return;
+    }
+
+    /// the reader needs the nearest batches first, a long range only gets as many as can be pending
+    const size_t batchesCount = std::min((endChunk - firstBatchStart + batchChunksCount - 1) / batchChunksCount, MAX_PENDING_READS_COUNT);
+
+    /// only the parts queued by the earlier calls make room, the reader is past them by now
+    while (m_pendingReads.size() + batchesCount > MAX_PENDING_READS_COUNT)
+    {
+        m_pendingReads.pop_front();
+    }
+
+    for (size_t batch = 0; batch < batchesCount; ++batch)
+    {
+        size_t batchStart = firstBatchStart + batch * batchChunksCount;
+        size_t batchEnd = std::min(batchStart + batchChunksCount, endChunk);
+        m_pendingReads.emplace_back(m_fat.chunkOffset(batchStart), m_fat.chunkOffset(batchEnd) - m_fat.chunkOffset(batchStart));
+    }
+}
+
+size_t Prefetcher::chunkAtDistance(size_t chunkIndex, size_t distance) const
+{
+    /// the chunk offsets only grow, search the first chunk that starts at least distance past chunkIndex
+    size_t first = chunkIndex;
+    size_t last = m_fat.chunksCount();
+    const size_t targetOffset = m_fat.chunkOffset(chunkIndex) + distance;
+
+    while (first < last)
+    {
+        size_t middle = first + (last - first) / 2;
+
+        if (m_fat.chunkOffset(middle) < targetOffset)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+
+    return first;
+}
+
+void Prefetcher::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_wakeUp.wait(lock, [this] { return m_isStopped || !m_pendingReads.empty(); });
+
+        if (m_isStopped)
+        {
+            return;
+        }
+
+        std::pair<size_t, size_t> pendingRead = m_pendingReads.front();
+        m_pendingReads.pop_front();
+
+        lock.unlock();
+
+        /// only a hint, a part that can't be read ahead fails again for the reader that really needs it
+        try
+        {
+            m_compressedFileMap.prefetch(pendingRead.first, pendingRead.second);
+        }
+        catch (std::exception&)
+        {
+        }
+
+        lock.lock();
+    }
+}
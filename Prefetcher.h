@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+#include "Fat.h"
+#include "CompressedFileMap.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/* Reads the archive ahead on a background I/O thread so the decompression threads find it in memory. Readers
+   report the chunks they read, once a few reads in a row walk the FAT sequentially or with short steps the next
+   PREFETCH_DISTANCE bytes of the archive are kept read ahead, and with a longer constant stride the next
+   PREFETCH_DEPTH reads of the walk. The parts are asked for in the same batches the readers map, so a prefetched page is the one the
+   reader will look for. */
+class Prefetcher
+{
+public:
+    /* fat only has to be read by the first onRead or prefetch */
+    Prefetcher(CompressedFileMap& compressedFileMap, const Fat& fat);
+
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    /* the chunks [firstChunk, endChunk) are being read, reads ahead the next ones if the reads so far follow a pattern */
+    void onRead(size_t firstChunk, size_t endChunk);
+
+    /* reads the chunks [firstChunk, endChunk) ahead, firstChunk starts a batch */
+    void prefetch(size_t firstChunk, size_t endChunk);
+
+private:
+    /* the I/O thread, reads the pending parts of the archive until the prefetcher goes away */
+    void run();
+
+    /* the first chunk starting at least distance bytes of the archive after chunkIndex, or chunksCount() */
+    size_t chunkAtDistance(size_t chunkIndex, size_t distance) const;
+
+    /* queues the nearest batches of [firstChunk, endChunk), at most MAX_PENDING_READS_COUNT, dropping the oldest
+       parts queued before. The lock is held */
+    void enqueue(size_t firstChunk, size_t endChunk);
+
+    CompressedFileMap& m_compressedFileMap;
+    const Fat& m_fat;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    bool m_isStopped;
+
+    /// offset and size of the parts of the archive to read, the oldest ones are dropped when the reader got ahead
+    std::deque<std::pair<size_t, size_t>> m_pendingReads;
+
+    /// the last read and the walk it is part of, m_streak reads long
+    size_t m_lastFirstChunk;
+    size_t m_lastEndChunk;
+    size_t m_stride;
+    size_t m_streak;
+
+    /// the chunks before it are already read ahead
+    size_t m_prefetchedEndChunk;
+
+    std::thread m_thread;
+};
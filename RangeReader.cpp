@@ -0,0 +1,251 @@
+#include "pch.h"
+#include "RangeReader.h"
+#include "Parallelism.h"
+#include <ppl.h>
+
+RangeReader::RangeReader(LPCWSTR compressedFilePath, CompressedFileMap::Mode mode, size_t chunkCacheSize, size_t compressedChunkCacheSize)
+    : m_compressedFileMap(compressedFilePath, mode)
+    , m_prefetcher(m_compressedFileMap, m_fat)
+{
+    m_fat.readFromArchive(compressedFilePath);
+
+    /// the read counts of the cache go by chunk, it needs the FAT first
+    if (chunkCacheSize != 0 || compressedChunkCacheSize != 0)
+    {
+        m_chunkCache = std::make_unique<TieredChunkCache>(m_fat.chunksCount(), chunkCacheSize, compressedChunkCacheSize);
+    }
+
+    if (m_fat.assetIndexSize() != 0)
+    {
+        m_assetIndex.open(m_fat.assetIndexData(), m_fat.assetIndexSize());
+    }
+}
+
+size_t RangeReader::read(size_t offset, void* dest, size_t length)
+{
+    if (offset >= m_fat.m_fileSize || length == 0)
+    {
+        return 0;
+    }
+
+    /// don't read past the end of the original file
+    length = std::min(length, m_fat.m_fileSize - offset);
+
+    size_t firstChunk = offset / m_fat.m_chunkSize;
+    size_t endChunk = (offset + length - 1) / m_fat.m_chunkSize + 1;
+    const size_t batchChunksCount = Parallelism::batchChunksCount(m_fat.m_chunkSize, m_fat.m_solidChunksCount);
+
+    /// the batches after the first are read ahead while the first one is inflated, and the next reads too if
+    /// this one continues a walk
+    m_prefetcher.prefetch(m_fat.solidGroupStart(firstChunk) + batchChunksCount, endChunk);
+    m_prefetcher.onRead(firstChunk, endChunk);
+
+    readRange(offset, reinterpret_cast<uint8_t*>(dest), length);
+
+    return length;
+}
+
+size_t RangeReader::fileSize() const
+{
+    return m_fat.m_fileSize;
+}
+
+const TieredChunkCache* RangeReader::chunkCache() const
+{
+    return m_chunkCache.get();
+}
+
+bool RangeReader::findAsset(LPCWSTR name, AssetIndex::Asset& asset) const
+{
+    return m_assetIndex.assetsCount() != 0 && m_assetIndex.find(name, asset);
+}
+
+void RangeReader::readRange(size_t offset, uint8_t* dest, size_t length)
+{
+    size_t firstChunk = offset / m_fat.m_chunkSize;
+    size_t endChunk = (offset + length - 1) / m_fat.m_chunkSize + 1;
+
+    /// a long read goes in batches of a few chunks per core, whole solid groups since a Solid chunk is inflated
+    /// after the ones before it in its group
+    const size_t batchChunksCount = Parallelism::batchChunksCount(m_fat.m_chunkSize, m_fat.m_solidChunksCount);
+
+    for (size_t batchStart = m_fat.solidGroupStart(firstChunk); batchStart < endChunk; batchStart += batchChunksCount)
+    {
+        size_t batchEnd = std::min(batchStart + batchChunksCount, endChunk);
+        readChunks(batchStart, batchEnd, offset, dest, length);
+    }
+}
+
+void RangeReader::readChunks(size_t firstChunk, size_t endChunk, size_t offset, uint8_t* dest, size_t length)
+{
+    /// a reference reads the same part of its referenced chunk
+    for (size_t i = firstChunk; i < endChunk; ++i)
+    {
+        size_t chunkStart = i * m_fat.m_chunkSize;
+        size_t copyStart = std::max(offset, chunkStart);
+        size_t copyEnd = std::min(offset + length, chunkStart + m_fat.chunkDecompressedSize(i));
+
+        if (m_fat.chunkType(i) == ChunkType::Reference && copyStart < copyEnd)
+        {
+            throwIfFalse(m_decompressor.isReferenceIntact(m_fat, i));
+
+            size_t referencedChunkStart = m_fat.referencedChunk(i) * m_fat.m_chunkSize;
+
+            /// not a read of the caller, the walk the prefetcher follows goes on past it
+            readRange(referencedChunkStart + (copyStart - chunkStart), dest + (copyStart - offset), copyEnd - copyStart);
+        }
+    }
+
+    /// each chunk reads the archive only once the cache can't serve it, a read of cached chunks never touches it
+    size_t groupsCount = (endChunk - firstChunk + m_fat.m_solidChunksCount - 1) / m_fat.m_solidChunksCount;
+
+    concurrency::parallel_for(size_t(0), groupsCount, [this, firstChunk, endChunk, offset, dest, length](size_t group)
+    {
+        size_t groupStart = firstChunk + group * m_fat.m_solidChunksCount;
+        size_t groupEnd = std::min(groupStart + m_fat.m_solidChunksCount, endChunk);
+
+        readSolidChunks(groupStart, groupEnd, offset, dest, length);
+
+        for (size_t i = groupStart; i < groupEnd; ++i)
+        {
+            if (m_fat.chunkType(i) != ChunkType::Solid && m_fat.chunkType(i) != ChunkType::Reference)
+            {
+                readChunk(i, offset, dest, length);
+            }
+        }
+    });
+}
+
+CompressedFileMap::View RangeReader::readCompressedChunks(size_t firstChunk, size_t endChunk)
+{
+    return m_compressedFileMap.readMem(m_fat.chunkOffset(firstChunk), m_fat.chunkOffset(endChunk) - m_fat.chunkOffset(firstChunk));
+}
+
+void RangeReader::readSolidChunks(size_t groupStart, size_t groupEnd, size_t offset, uint8_t* dest, size_t length)
+{
+    std::vector<uint8_t*> solidDests(groupEnd - groupStart, nullptr);
+    std::vector<std::pair<size_t, std::shared_ptr<Chunk>>> bufferedChunks;
+
+    /// the group is inflated up to the last requested chunk that isn't cached, the chunks before the range only
+    /// for their window
+    size_t solidEnd = groupStart;
+
+    for (size_t i = groupStart; i < groupEnd; ++i)
+    {
+        size_t chunkStart = i * m_fat.m_chunkSize;
+        size_t copyStart = std::max(offset, chunkStart);
+        size_t copyEnd = std::min(offset + length, chunkStart + m_fat.chunkDecompressedSize(i));
+
+        if (m_fat.chunkType(i) != ChunkType::Solid || copyStart >= copyEnd)
+        {
+            continue;
+        }
+
+        if (ChunkCache::Handle cachedChunk = m_chunkCache ? m_chunkCache->findHot(i) : nullptr)
+        {
+            memcpy(dest + (copyStart - offset), cachedChunk.get() + (copyStart - chunkStart), copyEnd - copyStart);
+            continue;
+        }
+
+        solidEnd = i + 1;
+
+        if (!m_chunkCache && copyEnd - copyStart == m_fat.chunkDecompressedSize(i))
+        {
+            /// the whole chunk is requested so inflate straight into dest
+            solidDests[i - groupStart] = dest + (chunkStart - offset);
+        }
+        else
+        {
+            bufferedChunks.emplace_back(i, std::make_shared<Chunk>(m_fat.m_chunkSize));
+            solidDests[i - groupStart] = reinterpret_cast<uint8_t*>(bufferedChunks.back().second->m_memory.get());
+        }
+    }
+
+    if (solidEnd == groupStart)
+    {
+        return;
+    }
+
+    CompressedFileMap::View compressedGroup = readCompressedChunks(groupStart, solidEnd);
+    throwIfFalse(m_decompressor.inflateSolidChunks(m_fat, groupStart, solidEnd, compressedGroup.get(), solidDests) == solidEnd);
+
+    for (auto& bufferedChunk : bufferedChunks)
+    {
+        size_t chunkStart = bufferedChunk.first * m_fat.m_chunkSize;
+        size_t copyStart = std::max(offset, chunkStart);
+        size_t copyEnd = std::min(offset + length, chunkStart + m_fat.chunkDecompressedSize(bufferedChunk.first));
+        uint8_t* chunkMem = reinterpret_cast<uint8_t*>(bufferedChunk.second->m_memory.get());
+
+        memcpy(dest + (copyStart - offset), chunkMem + (copyStart - chunkStart), copyEnd - copyStart);
+
+        /// a Solid chunk can't be inflated without its group, it is never kept compressed
+        if (m_chunkCache)
+        {
+            m_chunkCache->insert(bufferedChunk.first, ChunkCache::Handle(bufferedChunk.second, chunkMem), m_fat.m_chunkSize, nullptr, 0);
+        }
+    }
+}
+
+void RangeReader::readChunk(size_t chunkIndex, size_t offset, uint8_t* dest, size_t length)
+{
+    /// the part of the requested range that lies in this chunk
+    size_t chunkStart = chunkIndex * m_fat.m_chunkSize;
+    size_t copyStart = std::max(offset, chunkStart);
+    size_t copyEnd = std::min(offset + length, chunkStart + m_fat.chunkDecompressedSize(chunkIndex));
+
+    /// the batch starts with the solid group of the range start, the chunks before the range are only there for Solid ones
+    if (copyStart >= copyEnd)
+    {
+        return;
+    }
+
+    if (m_fat.chunkType(chunkIndex) == ChunkType::Fill)
+    {
+        throwIfFalse(m_decompressor.isFillChunkIntact(m_fat, chunkIndex));
+        memset(dest + (copyStart - offset), m_fat.chunkParameter(chunkIndex), copyEnd - copyStart);
+    }
+    else if (m_fat.chunkType(chunkIndex) == ChunkType::Stored)
+    {
+        /// raw bytes, copy just the requested part straight from the compressed file
+        CompressedFileMap::View compressedChunk = readCompressedChunks(chunkIndex, chunkIndex + 1);
+
+        throwIfFalse(m_decompressor.isCompressedChunkIntact(m_fat, chunkIndex, compressedChunk.get()));
+        memcpy(dest + (copyStart - offset), compressedChunk.get() + (copyStart - chunkStart), copyEnd - copyStart);
+    }
+    else if (m_chunkCache)
+    {
+        ChunkCache::Handle chunk = m_chunkCache->findHot(chunkIndex);
+
+        if (!chunk)
+        {
+            /// a warm chunk is inflated from its copy, only a cold one reads the archive
+            ChunkCache::Handle warmChunk = m_chunkCache->findWarm(chunkIndex);
+            CompressedFileMap::View compressedChunk = warmChunk ? nullptr : readCompressedChunks(chunkIndex, chunkIndex + 1);
+            uint8_t* compressedMem = warmChunk ? const_cast<uint8_t*>(warmChunk.get()) : compressedChunk.get();
+
+            auto decompressedChunk = std::make_shared<Chunk>(m_fat.m_chunkSize);
+            uint8_t* chunkMem = reinterpret_cast<uint8_t*>(decompressedChunk->m_memory.get());
+
+            m_decompressor.decompressChunk(m_fat, chunkIndex, compressedMem, chunkMem, m_fat.m_chunkSize);
+            chunk = m_chunkCache->insert(chunkIndex, ChunkCache::Handle(decompressedChunk, chunkMem), m_fat.m_chunkSize,
+                warmChunk ? nullptr : compressedChunk.get(), m_fat.compressedChunkSize(chunkIndex));
+        }
+
+        memcpy(dest + (copyStart - offset), chunk.get() + (copyStart - chunkStart), copyEnd - copyStart);
+    }
+    else if (copyEnd - copyStart == m_fat.chunkDecompressedSize(chunkIndex))
+    {
+        /// the whole chunk is requested so inflate straight into dest
+        CompressedFileMap::View compressedChunk = readCompressedChunks(chunkIndex, chunkIndex + 1);
+        m_decompressor.decompressChunk(m_fat, chunkIndex, compressedChunk.get(), dest + (chunkStart - offset), m_fat.chunkDecompressedSize(chunkIndex));
+    }
+    else
+    {
+        CompressedFileMap::View compressedChunk = readCompressedChunks(chunkIndex, chunkIndex + 1);
+        Chunk chunk(m_fat.m_chunkSize);
+        uint8_t* chunkMem = reinterpret_cast<uint8_t*>(chunk.m_memory.get());
+
+        m_decompressor.decompressChunk(m_fat, chunkIndex, compressedChunk.get(), chunkMem, m_fat.m_chunkSize);
+        memcpy(dest + (copyStart - offset), chunkMem + (copyStart - chunkStart), copyEnd - copyStart);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "pch.h"
+#include "Fat.h"
+#include "CompressedFileMap.h"
+#include "Decompressor.h"
+#include "AssetIndex.h"
+#include "Prefetcher.h"
+#include "TieredChunkCache.h"
+
+/* Reads arbitrary byte ranges of the original file, inflating only the chunks that overlap the range */
+class RangeReader
+{
+public:
+    /* chunkCacheSize bytes of decompressed chunks and compressedChunkCacheSize bytes of compressed chunks are kept
+       for the next reads of the same chunks, both 0 inflate them from the archive every time */
+    RangeReader(LPCWSTR compressedFilePath, CompressedFileMap::Mode mode = CompressedFileMap::Mode::Mapped, size_t chunkCacheSize = 0,
+        size_t compressedChunkCacheSize = 0);
+
+    /* copy up to length bytes starting at offset of the original file into dest, returns the copied bytes count.
+       Threads can read at the same time, they share the cache of the archive pages */
+    size_t read(size_t offset, void* dest, size_t length);
+
+    size_t fileSize() const;
+
+    /* the cache of hot and warm chunks with the hit and miss counts of each tier, nullptr without one */
+    const TieredChunkCache* chunkCache() const;
+
+    /* looks up an asset of a pack by name, its range can then be read like any other, returns false when there is
+       no such asset or the archive is not a pack */
+    bool findAsset(LPCWSTR name, AssetIndex::Asset& asset) const;
+
+private:
+    /* reads [offset, offset + length) of the original file, which has to be in the file, without telling the prefetcher */
+    void readRange(size_t offset, uint8_t* dest, size_t length);
+
+    /* reads the part of [offset, offset + length) in the chunks [firstChunk, endChunk), whole solid groups */
+    void readChunks(size_t firstChunk, size_t endChunk, size_t offset, uint8_t* dest, size_t length);
+
+    /* the archive bytes of the chunks [firstChunk, endChunk) */
+    CompressedFileMap::View readCompressedChunks(size_t firstChunk, size_t endChunk);
+
+    /* reads the part of the range in the Solid chunks of the group, inflating the group from its start up to
+       the last one the cache doesn't have */
+    void readSolidChunks(size_t groupStart, size_t groupEnd, size_t offset, uint8_t* dest, size_t length);
+
+    /* reads the part of the range in a chunk that isn't Solid nor a Reference, from the cache when it has it */
+    void readChunk(size_t chunkIndex, size_t offset, uint8_t* dest, size_t length);
+
+    Fat m_fat;
+    CompressedFileMap m_compressedFileMap;
+    Decompressor m_decompressor;
+    AssetIndex m_assetIndex;
+    std::unique_ptr<TieredChunkCache> m_chunkCache;
+
+    /// last, it reads from the map and the FAT on its own thread until it goes
+    Prefetcher m_prefetcher;
+};
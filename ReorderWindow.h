@@ -0,0 +1,49 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+
+/* Bounds how far the producer of a pipeline gets ahead of the next index the writer waits for. Workers finish out
+   of order and the writer parks the early items until their turn, without a bound one slow item lets the others
+   pile up behind it, with whatever memory they hold */
+class ReorderWindow
+{
+public:
+    explicit ReorderWindow(size_t size) : m_size(size), m_nextIndex(0), m_closed(false) {}
+
+    ReorderWindow(const ReorderWindow&) = delete;
+    ReorderWindow& operator=(const ReorderWindow&) = delete;
+
+    /* blocks until the items before endIndex fit in the window, returns false if the window got closed */
+    bool waitFor(size_t endIndex)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this, endIndex] { return endIndex <= m_nextIndex + m_size || m_closed; });
+
+        return !m_closed;
+    }
+
+    /* the items before nextIndex are written */
+    void advance(size_t nextIndex)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nextIndex = nextIndex;
+
+        m_notFull.notify_all();
+    }
+
+    /* no more waiting, the producer stops */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+
+        m_notFull.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    size_t m_size;
+    size_t m_nextIndex;
+    bool m_closed;
+};
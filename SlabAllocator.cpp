@@ -0,0 +1,216 @@
+#include "pch.h"
+#include "SlabAllocator.h"
+#include <mutex>
+
+namespace
+{
+    /// block sizes are powers of two from 4 KB to 8 MB plus some slack, so PAGE_SIZE buffers and
+    /// their deflateBound don't end up in the next class
+    const size_t MIN_CLASS_SHIFT = 12;
+    const size_t CLASSES_COUNT = 12;
+    const size_t BLOCK_SLACK = 4 * 1024;
+    const size_t LARGE_CLASS = CLASSES_COUNT;
+
+    const size_t SLAB_SIZE = 4 * 1024 * 1024;
+
+    /// how many blocks a thread takes from or gives back to the shared lists at a time
+    const size_t TRANSFER_BATCH_COUNT = 8;
+    const size_t MAX_THREAD_CACHED_COUNT = 4 * TRANSFER_BATCH_COUNT;
+
+    /// in front of every block, keeps the class so free() doesn't need the size
+    struct alignas(64) BlockHeader
+    {
+        size_t m_class;
+    };
+
+    size_t blockSize(size_t sizeClass)
+    {
+        return (size_t(1) << (MIN_CLASS_SHIFT + sizeClass)) + BLOCK_SLACK;
+    }
+
+    size_t sizeClassOf(size_t size)
+    {
+        for (size_t sizeClass = 0; sizeClass < CLASSES_COUNT; ++sizeClass)
+        {
+            if (size + sizeof(BlockHeader) <= blockSize(sizeClass))
+            {
+                return sizeClass;
+            }
+        }
+
+        return LARGE_CLASS;
+    }
+
+    struct SharedFreeLists
+    {
+        void allocateSlab(size_t sizeClass, std::vector<BlockHeader*>& out)
+        {
+            size_t size = blockSize(sizeClass);
+            size_t blocksCount = std::max<size_t>(1, SLAB_SIZE / size);
+
+            uint8_t* slab = reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, blocksCount * size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            if (!slab)
+            {
+                throw std::bad_alloc();
+            }
+
+            for (size_t i = 0; i < blocksCount; ++i)
+            {
+                BlockHeader* block = reinterpret_cast<BlockHeader*>(slab + i * size);
+                block->m_class = sizeClass;
+                out.push_back(block);
+            }
+        }
+
+        void take(size_t sizeClass, std::vector<BlockHeader*>& out)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& freeList = m_freeLists[sizeClass];
+
+            if (freeList.empty())
+            {
+                allocateSlab(sizeClass, freeList);
+            }
+
+            size_t count = std::min(TRANSFER_BATCH_COUNT, freeList.size());
+            out.insert(out.end(), freeList.end() - count, freeList.end());
+            freeList.resize(freeList.size() - count);
+        }
+
+        void give(size_t sizeClass, std::vector<BlockHeader*>& in, size_t count)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& freeList = m_freeLists[sizeClass];
+
+            freeList.insert(freeList.end(), in.end() - count, in.end());
+            in.resize(in.size() - count);
+        }
+
+        std::mutex m_mutex;
+        std::vector<BlockHeader*> m_freeLists[CLASSES_COUNT];
+    };
+
+    /// never destroyed, threads may still give blocks back while statics are torn down
+    SharedFreeLists& sharedFreeLists()
+    {
+        static SharedFreeLists* lists = new SharedFreeLists();
+        return *lists;
+    }
+
+    /// other thread_local destructors (pooled z_streams) may still free blocks after the thread's lists are gone
+    thread_local bool threadFreeListsDestroyed = false;
+
+    struct ThreadFreeLists
+    {
+        ~ThreadFreeLists()
+        {
+            threadFreeListsDestroyed = true;
+
+            for (size_t sizeClass = 0; sizeClass < CLASSES_COUNT; ++sizeClass)
+            {
+                sharedFreeLists().give(sizeClass, m_freeLists[sizeClass], m_freeLists[sizeClass].size());
+            }
+        }
+
+        std::vector<BlockHeader*> m_freeLists[CLASSES_COUNT];
+    };
+
+    thread_local ThreadFreeLists threadFreeLists;
+
+    /// the calling thread's free list of sizeClass, or a scratch list going straight to the shared lists on thread exit
+    std::vector<BlockHeader*>& threadFreeList(size_t sizeClass, std::vector<BlockHeader*>& exitingThreadList)
+    {
+        return threadFreeListsDestroyed ? exitingThreadList : threadFreeLists.m_freeLists[sizeClass];
+    }
+}
+
+void* SlabAllocator::allocate(size_t size)
+{
+    size_t sizeClass = sizeClassOf(size);
+    BlockHeader* block;
+
+    if (sizeClass == LARGE_CLASS)
+    {
+        /// too big to pool, goes straight to the OS
+        block = reinterpret_cast<BlockHeader*>(VirtualAlloc(nullptr, size + sizeof(BlockHeader), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+
+        block->m_class = LARGE_CLASS;
+    }
+    else
+    {
+        std::vector<BlockHeader*> exitingThreadList;
+        auto& freeList = threadFreeList(sizeClass, exitingThreadList);
+
+        if (freeList.empty())
+        {
+            sharedFreeLists().take(sizeClass, freeList);
+        }
+
+        block = freeList.back();
+        freeList.pop_back();
+
+        if (!exitingThreadList.empty())
+        {
+            sharedFreeLists().give(sizeClass, exitingThreadList, exitingThreadList.size());
+        }
+    }
+
+    return block + 1;
+}
+
+void SlabAllocator::free(void* ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(ptr) - 1;
+
+    if (block->m_class == LARGE_CLASS)
+    {
+        BOOL ret = VirtualFree(block, 0, MEM_RELEASE);
+        assert(ret);
+        (void)ret;
+        return;
+    }
+
+    std::vector<BlockHeader*> exitingThreadList;
+    auto& freeList = threadFreeList(block->m_class, exitingThreadList);
+    freeList.push_back(block);
+
+    /// blocks freed by another thread than the one that allocated them pile up here, hand them back
+    if (!exitingThreadList.empty())
+    {
+        sharedFreeLists().give(block->m_class, exitingThreadList, exitingThreadList.size());
+    }
+    else if (freeList.size() > MAX_THREAD_CACHED_COUNT)
+    {
+        sharedFreeLists().give(block->m_class, freeList, freeList.size() - MAX_THREAD_CACHED_COUNT / 2);
+    }
+}
+
+voidpf SlabAllocator::zalloc(voidpf opaque, uInt items, uInt size)
+{
+    (void)opaque;
+
+    try
+    {
+        return allocate(static_cast<size_t>(items) * size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        /// zlib reports Z_MEM_ERROR on a null allocation
+        return Z_NULL;
+    }
+}
+
+void SlabAllocator::zfree(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    free(address);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include "zlib.h"
+
+/* Fixed size class allocator for chunk buffers and zlib state. Blocks are carved out of big slabs that
+   are never given back to the OS and recycled through per thread free lists, so the number of
+   VirtualAlloc calls stays flat however many chunks go through. */
+namespace SlabAllocator
+{
+    void* allocate(size_t size);
+
+    void free(void* ptr);
+
+    /* zalloc/zfree hooks for z_stream */
+    voidpf zalloc(voidpf opaque, uInt items, uInt size);
+
+    void zfree(voidpf opaque, voidpf address);
+}
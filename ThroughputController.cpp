@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "ThroughputController.h"
+
+namespace
+{
+    /// long enough to see a few chunks of every worker, short enough to react within a second
+    const std::chrono::milliseconds ADJUST_INTERVAL(100);
+
+    /// the recent throughput has to be off by this much before the level moves
+    const double SLOWER_MARGIN = 0.95;
+    const double FASTER_MARGIN = 1.10;
+
+    const int MIN_LEVEL = 1;
+
+    /// below level 1, the step deflating with Z_HUFFMAN_ONLY
+    const int HUFFMAN_ONLY_STEP = 0;
+
+    /// a step needs this much input measured before its speed and ratio are trusted
+    const size_t MIN_MEASURED_BYTES = 1024 * 1024;
+
+    /// share of the output the step above has to save to be worth its time
+    const double MIN_RATIO_GAIN = 0.01;
+}
+
+std::unique_ptr<ThroughputController> ThroughputController::forThroughput(double bytesPerSecond)
+{
+    throwIfFalse(bytesPerSecond > 0);
+
+    return std::unique_ptr<ThroughputController>(new ThroughputController(bytesPerSecond, std::chrono::steady_clock::duration::zero()));
+}
+
+std::unique_ptr<ThroughputController> ThroughputController::forDeadline(std::chrono::steady_clock::duration duration)
+{
+    throwIfFalse(duration > std::chrono::steady_clock::duration::zero());
+
+    return std::unique_ptr<ThroughputController>(new ThroughputController(0, duration));
+}
+
+ThroughputController::ThroughputController(double bytesPerSecond, std::chrono::steady_clock::duration duration)
+    : m_bytesPerSecond(bytesPerSecond)
+    , m_duration(duration)
+    , m_step(COMPRESSION_LEVEL)
+    , m_remainingBytes(0)
+    , m_intervalBytes(0)
+    , m_statistics(COMPRESSION_LEVEL + 1, LevelStatistics())
+    , m_huffmanOnlyStatistics()
+{
+}
+
+void ThroughputController::start(size_t inputSize)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto now = std::chrono::steady_clock::now();
+
+    /// a throughput target is the deadline of this input
+    auto duration = m_bytesPerSecond > 0
+        ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(inputSize / m_bytesPerSecond))
+        : m_duration;
+
+    m_deadline = now + duration;
+    m_intervalStart = now;
+    m_remainingBytes = inputSize;
+    m_intervalBytes = 0;
+    m_statistics.assign(COMPRESSION_LEVEL + 1, LevelStatistics());
+    m_huffmanOnlyStatistics = LevelStatistics();
+    m_step = COMPRESSION_LEVEL;
+}
+
+int ThroughputController::maxLevel() const
+{
+    return std::max(MIN_LEVEL, m_step.load());
+}
+
+int ThroughputController::strategy() const
+{
+    return m_step == HUFFMAN_ONLY_STEP ? Z_HUFFMAN_ONLY : Z_DEFAULT_STRATEGY;
+}
+
+void ThroughputController::record(int level, int strategy, size_t inputBytes, size_t outputBytes, std::chrono::steady_clock::duration deflateTime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    LevelStatistics& statistics = level != 0 && strategy == Z_HUFFMAN_ONLY ? m_huffmanOnlyStatistics : m_statistics[level];
+    ++statistics.m_chunksCount;
+    statistics.m_inputBytes += inputBytes;
+    statistics.m_outputBytes += outputBytes;
+    statistics.m_deflateTime += deflateTime;
+
+    m_remainingBytes -= std::min(m_remainingBytes, inputBytes);
+    m_intervalBytes += inputBytes;
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - m_intervalStart >= ADJUST_INTERVAL)
+    {
+        adjust(now);
+    }
+}
+
+std::vector<ThroughputController::LevelStatistics> ThroughputController::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_statistics;
+}
+
+ThroughputController::LevelStatistics ThroughputController::huffmanOnlyStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_huffmanOnlyStatistics;
+}
+
+void ThroughputController::adjust(std::chrono::steady_clock::time_point now)
+{
+    double intervalThroughput = m_intervalBytes / std::chrono::duration<double>(now - m_intervalStart).count();
+    double remainingSeconds = std::chrono::duration<double>(m_deadline - now).count();
+    int step = m_step;
+
+    /// what the rest of the input needs from now on, late already means as fast as possible
+    if (remainingSeconds <= 0)
+    {
+        step = HUFFMAN_ONLY_STEP;
+    }
+    else
+    {
+        double neededThroughput = m_remainingBytes / remainingSeconds;
+
+        if (intervalThroughput < neededThroughput * SLOWER_MARGIN)
+        {
+            step = std::max(HUFFMAN_ONLY_STEP, step - 1);
+        }
+        else if (intervalThroughput > neededThroughput * FASTER_MARGIN && step < COMPRESSION_LEVEL
+            && isWorthSteppingUp(step, intervalThroughput, neededThroughput))
+        {
+            ++step;
+        }
+    }
+
+    m_step = step;
+    m_intervalStart = now;
+    m_intervalBytes = 0;
+}
+
+bool ThroughputController::isWorthSteppingUp(int step, double intervalThroughput, double neededThroughput) const
+{
+    const LevelStatistics& current = stepStatistics(step);
+    const LevelStatistics& above = stepStatistics(step + 1);
+
+    /// nothing to compare yet, the only way to know is to try it
+    if (current.m_inputBytes < MIN_MEASURED_BYTES || above.m_inputBytes < MIN_MEASURED_BYTES || current.m_outputBytes == 0)
+    {
+        return true;
+    }
+
+    /// the pool slows down by how much longer a byte takes above, a step that can't hold the target would be left again
+    double currentSecondsPerByte = std::chrono::duration<double>(current.m_deflateTime).count() / current.m_inputBytes;
+    double aboveSecondsPerByte = std::chrono::duration<double>(above.m_deflateTime).count() / above.m_inputBytes;
+
+    if (aboveSecondsPerByte > 0 && intervalThroughput * currentSecondsPerByte / aboveSecondsPerByte < neededThroughput * SLOWER_MARGIN)
+    {
+        return false;
+    }
+
+    /// the time is only worth spending if the chunks come out smaller
+    double currentRatio = static_cast<double>(current.m_outputBytes) / current.m_inputBytes;
+    double aboveRatio = static_cast<double>(above.m_outputBytes) / above.m_inputBytes;
+
+    return aboveRatio < currentRatio * (1 - MIN_RATIO_GAIN);
+}
+
+const ThroughputController::LevelStatistics& ThroughputController::stepStatistics(int step) const
+{
+    return step == HUFFMAN_ONLY_STEP ? m_huffmanOnlyStatistics : m_statistics[step];
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "pch.h"
+#include <atomic>
+#include <mutex>
+
+/* Feedback loop holding the compression to a deadline, for builds that want the best ratio that still finishes
+   at a given speed. The workers ask for the highest deflate level and the strategy they may use before each
+   chunk and report how long the chunk took and what it gave, every ADJUST_INTERVAL the controller compares the
+   recent throughput of the whole pool with what the rest of the input needs to make the deadline and moves one
+   step. The steps are the levels from 1 to COMPRESSION_LEVEL and, below level 1, Z_HUFFMAN_ONLY which skips the
+   match search altogether. Going up a step also has to pay off on what the two steps measured so far: the step
+   above has to be about fast enough for the target and to shrink the chunks noticeably more, else the cheaper
+   step stays. Levels differ a lot in speed, so the step ends up alternating between the two around the target. */
+class ThroughputController
+{
+public:
+    /* what the chunks compressed at one level gave, level 0 counts the chunks that weren't deflated */
+    struct LevelStatistics
+    {
+        size_t m_chunksCount;
+        size_t m_inputBytes;
+        size_t m_outputBytes;
+        std::chrono::steady_clock::duration m_deflateTime;
+    };
+
+    /* compress at bytesPerSecond of input at least */
+    static std::unique_ptr<ThroughputController> forThroughput(double bytesPerSecond);
+
+    /* compress the whole input in duration at most */
+    static std::unique_ptr<ThroughputController> forDeadline(std::chrono::steady_clock::duration duration);
+
+    /* the clock starts, inputSize bytes are to be compressed */
+    void start(size_t inputSize);
+
+    /* the highest level the next chunk may be deflated at */
+    int maxLevel() const;
+
+    /* the strategy the next chunks are deflated with, Z_HUFFMAN_ONLY once level 1 is too slow, else Z_DEFAULT_STRATEGY
+       and the strategy of the chunk is up to the compressor */
+    int strategy() const;
+
+    /* a chunk is done, deflated at level with strategy or not deflated with level 0 */
+    void record(int level, int strategy, size_t inputBytes, size_t outputBytes, std::chrono::steady_clock::duration deflateTime);
+
+    /* indexed by level, from 0 to COMPRESSION_LEVEL, without the chunks deflated with Z_HUFFMAN_ONLY */
+    std::vector<LevelStatistics> statistics() const;
+
+    /* the chunks deflated with Z_HUFFMAN_ONLY, the level doesn't matter to it */
+    LevelStatistics huffmanOnlyStatistics() const;
+
+private:
+    ThroughputController(double bytesPerSecond, std::chrono::steady_clock::duration duration);
+
+    void adjust(std::chrono::steady_clock::time_point now);
+
+    /* whether the step above step is worth going to at the throughput the pool needs, from what both measured */
+    bool isWorthSteppingUp(int step, double intervalThroughput, double neededThroughput) const;
+
+    /* what the chunks compressed at step gave, step 0 is Z_HUFFMAN_ONLY */
+    const LevelStatistics& stepStatistics(int step) const;
+
+    /// one of the two is set
+    double m_bytesPerSecond;
+    std::chrono::steady_clock::duration m_duration;
+
+    /// 0 deflates with Z_HUFFMAN_ONLY, the others are the level
+    std::atomic<int> m_step;
+
+    mutable std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_deadline;
+    std::chrono::steady_clock::time_point m_intervalStart;
+    size_t m_remainingBytes;
+    size_t m_intervalBytes;
+    std::vector<LevelStatistics> m_statistics;
+    LevelStatistics m_huffmanOnlyStatistics;
+};
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "TieredChunkCache.h"
+
+namespace
+{
+    /// reads that make a warm chunk hot
+    const uint8_t PROMOTION_READS_COUNT = 2;
+
+    /// the read counts are halved every that many reads per chunk of the archive
+    const size_t AGING_READS_PER_CHUNK = 4;
+}
+
+TieredChunkCache::TieredChunkCache(size_t chunksCount, size_t hotBudget, size_t warmBudget)
+    : m_hotChunks(hotBudget != 0 ? std::make_unique<ChunkCache>(hotBudget) : nullptr)
+    , m_warmChunks(warmBudget != 0 ? std::make_unique<ChunkCache>(warmBudget) : nullptr)
+    , m_chunksCount(chunksCount)
+    , m_readCounts(new std::atomic<uint8_t>[chunksCount])
+    , m_readsSinceAging(0)
+{
+    for (size_t i = 0; i < chunksCount; ++i)
+    {
+        m_readCounts[i] = 0;
+    }
+}
+
+ChunkCache::Handle TieredChunkCache::findHot(size_t chunkIndex)
+{
+    uint8_t readCount = m_readCounts[chunkIndex];
+
+    /// a lost increment between two readers only delays the promotion
+    if (readCount != UINT8_MAX)
+    {
+        m_readCounts[chunkIndex] = readCount + 1;
+    }
+
+    age();
+
+    return m_hotChunks ? m_hotChunks->find(chunkIndex) : nullptr;
+}
+
+ChunkCache::Handle TieredChunkCache::findWarm(size_t chunkIndex)
+{
+    return m_warmChunks ? m_warmChunks->find(chunkIndex) : nullptr;
+}
+
+ChunkCache::Handle TieredChunkCache::insert(size_t chunkIndex, ChunkCache::Handle decompressed, size_t decompressedSize,
+    const uint8_t* compressed, size_t compressedSize)
+{
+    if (m_warmChunks && compressed)
+    {
+        /// a copy, the archive pages go away
+        auto compressedChunk = std::make_shared<Chunk>(compressedSize);
+        uint8_t* compressedMem = reinterpret_cast<uint8_t*>(compressedChunk->m_memory.get());
+
+        memcpy(compressedMem, compressed, compressedSize);
+        m_warmChunks->insert(chunkIndex, ChunkCache::Handle(compressedChunk, compressedMem), compressedSize);
+    }
+
+    if (!m_hotChunks || (m_warmChunks && m_readCounts[chunkIndex] < PROMOTION_READS_COUNT))
+    {
+        return decompressed;
+    }
+
+    std::vector<size_t> demotedChunks;
+    ChunkCache::Handle hotChunk = m_hotChunks->insert(chunkIndex, std::move(decompressed), decompressedSize, &demotedChunks);
+
+    /// the demoted chunks that are still warm go to the front of the warm tier
+    for (size_t demotedChunk : demotedChunks)
+    {
+        if (m_warmChunks)
+        {
+            m_warmChunks->touch(demotedChunk);
+        }
+    }
+
+    return hotChunk;
+}
+
+TieredChunkCache::Statistics TieredChunkCache::statistics() const
+{
+    Statistics statistics = {};
+
+    if (m_hotChunks)
+    {
+        statistics.m_hot = m_hotChunks->statistics();
+    }
+
+    if (m_warmChunks)
+    {
+        statistics.m_warm = m_warmChunks->statistics();
+    }
+
+    return statistics;
+}
+
+void TieredChunkCache::age()
+{
+    size_t readsSinceAging = ++m_readsSinceAging;
+
+    /// only the reader that crosses the period ages the counts
+    if (readsSinceAging != AGING_READS_PER_CHUNK * m_chunksCount)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < m_chunksCount; ++i)
+    {
+        m_readCounts[i] = m_readCounts[i] / 2;
+    }
+
+    m_readsSinceAging -= AGING_READS_PER_CHUNK * m_chunksCount;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "pch.h"
+#include "ChunkCache.h"
+#include <atomic>
+
+/* Two tiers of cached chunks in front of the archive, for working sets that fit in memory compressed but not
+   decompressed. Hot chunks are kept decompressed, warm chunks as their compressed bytes and cold chunks are read
+   from the archive. A cold chunk becomes warm on its first read and hot once it was read PROMOTION_READS_COUNT
+   times lately, the read counts are halved every few reads per chunk so a chunk that stops being read doesn't
+   stay ahead of the new ones. The warm tier holds the hot chunks too, a chunk the hot tier evicts is moved to the
+   front of the warm tier so it is demoted to warm rather than cold. */
+class TieredChunkCache
+{
+public:
+    struct Statistics
+    {
+        ChunkCache::Statistics m_hot;
+        ChunkCache::Statistics m_warm;
+    };
+
+    /* hotBudget bytes of decompressed chunks and warmBudget bytes of compressed chunks at most, a tier without
+       budget is left out. Without a warm tier a chunk is hot from its first read */
+    TieredChunkCache(size_t chunksCount, size_t hotBudget, size_t warmBudget);
+
+    TieredChunkCache(const TieredChunkCache&) = delete;
+    TieredChunkCache& operator=(const TieredChunkCache&) = delete;
+
+    /* the decompressed chunk if it is hot, nullptr otherwise. Counts a read of the chunk */
+    ChunkCache::Handle findHot(size_t chunkIndex);
+
+    /* the compressed chunk if it is warm, nullptr otherwise */
+    ChunkCache::Handle findWarm(size_t chunkIndex);
+
+    /* a chunk that wasn't hot got inflated into decompressed. compressed is the archive when the chunk was cold,
+       nullptr when it was warm or can't be inflated on its own. Keeps the chunk in the tiers its reads earn it
+       and returns its decompressed handle */
+    ChunkCache::Handle insert(size_t chunkIndex, ChunkCache::Handle decompressed, size_t decompressedSize,
+        const uint8_t* compressed, size_t compressedSize);
+
+    Statistics statistics() const;
+
+private:
+    /* halves every read count once enough reads went by */
+    void age();
+
+    std::unique_ptr<ChunkCache> m_hotChunks;
+    std::unique_ptr<ChunkCache> m_warmChunks;
+
+    /// recent reads of each chunk, saturated at 255
+    const size_t m_chunksCount;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_readCounts;
+    std::atomic<size_t> m_readsSinceAging;
+};
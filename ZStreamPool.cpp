@@ -0,0 +1,117 @@
+#include "pch.h"
+#include "ZStreamPool.h"
+
+namespace
+{
+    /// more idle streams than this per thread are ended instead of kept
+    const size_t MAX_IDLE_STREAMS_PER_THREAD = 4;
+
+    void endStream(ZStreamPool::PooledStream* stream)
+    {
+        if (stream->m_isDeflate)
+        {
+            (void)deflateEnd(&stream->m_stream);
+        }
+        else
+        {
+            (void)inflateEnd(&stream->m_stream);
+        }
+
+        delete stream;
+    }
+
+    struct ThreadStreams
+    {
+        ~ThreadStreams()
+        {
+            for (auto stream : m_idleStreams)
+            {
+                endStream(stream);
+            }
+        }
+
+        std::vector<ZStreamPool::PooledStream*> m_idleStreams;
+    };
+
+    thread_local ThreadStreams threadStreams;
+}
+
+void ZStreamPool::Releaser::operator()(PooledStream* stream)
+{
+    auto& idleStreams = threadStreams.m_idleStreams;
+
+    if (idleStreams.size() < MAX_IDLE_STREAMS_PER_THREAD)
+    {
+        idleStreams.push_back(stream);
+    }
+    else
+    {
+        endStream(stream);
+    }
+}
+
+ZStreamPool::Stream ZStreamPool::acquireDeflate(int level, int windowBits, int strategy)
+{
+    return acquire(true, level, windowBits, strategy);
+}
+
+ZStreamPool::Stream ZStreamPool::acquireInflate(int windowBits)
+{
+    return acquire(false, 0, windowBits, Z_DEFAULT_STRATEGY);
+}
+
+ZStreamPool::Stream ZStreamPool::acquire(bool isDeflate, int level, int windowBits, int strategy)
+{
+    auto& idleStreams = threadStreams.m_idleStreams;
+
+    /// reuse an idle stream with the same window, the level and the strategy vary from chunk to chunk
+    for (size_t i = 0; i < idleStreams.size(); ++i)
+    {
+        PooledStream* stream = idleStreams[i];
+
+        if (stream->m_isDeflate == isDeflate && stream->m_windowBits == windowBits)
+        {
+            idleStreams.erase(idleStreams.begin() + i);
+
+            int ret = isDeflate ? deflateReset(&stream->m_stream) : inflateReset(&stream->m_stream);
+
+            /// right after the reset there is no input to flush, deflateParams only switches the parameters
+            if (ret == Z_OK && isDeflate && (stream->m_level != level || stream->m_strategy != strategy))
+            {
+                ret = deflateParams(&stream->m_stream, level, strategy);
+                stream->m_level = level;
+                stream->m_strategy = strategy;
+            }
+
+            if (ret != Z_OK)
+            {
+                endStream(stream);
+                throw std::exception();
+            }
+
+            return Stream(stream);
+        }
+    }
+
+    std::unique_ptr<PooledStream> stream(new PooledStream());
+    stream->m_isDeflate = isDeflate;
+    stream->m_level = level;
+    stream->m_windowBits = windowBits;
+    stream->m_strategy = strategy;
+    stream->m_stream.zalloc = SlabAllocator::zalloc;
+    stream->m_stream.zfree = SlabAllocator::zfree;
+    stream->m_stream.opaque = Z_NULL;
+    stream->m_stream.avail_in = 0;
+    stream->m_stream.next_in = Z_NULL;
+
+    if (isDeflate)
+    {
+        throwIfFailed(deflateInit2(&stream->m_stream, level, Z_DEFLATED, windowBits, 8, strategy));
+    }
+    else
+    {
+        throwIfFailed(inflateInit2(&stream->m_stream, windowBits));
+    }
+
+    return Stream(stream.release());
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "pch.h"
+
+/* Per thread pool of initialized zlib streams. A stream is set up once with deflateInit2/inflateInit2
+   and then recycled with deflateReset/inflateReset, so a chunk doesn't pay for allocating and
+   zeroing the deflate window, prev and head arrays every time. Deflate streams are told apart only by their
+   window bits, a recycled one gets the level and strategy of the chunk through deflateParams. */
+class ZStreamPool
+{
+public:
+    struct PooledStream
+    {
+        z_stream m_stream;
+        bool m_isDeflate;
+        int m_level;
+        int m_windowBits;
+        int m_strategy;
+    };
+
+    /* gives the stream back to the pool of the releasing thread */
+    struct Releaser
+    {
+        void operator()(PooledStream* stream);
+    };
+
+    using Stream = std::unique_ptr<PooledStream, Releaser>;
+
+    /* a deflate stream ready to compress a new zlib (or raw, with negative windowBits) stream */
+    static Stream acquireDeflate(int level, int windowBits = MAX_WBITS, int strategy = Z_DEFAULT_STRATEGY);
+
+    /* an inflate stream ready to decompress a new stream */
+    static Stream acquireInflate(int windowBits = MAX_WBITS);
+
+private:
+    static Stream acquire(bool isDeflate, int level, int windowBits, int strategy);
+};
@@ -1,6 +1,11 @@
 #include "pch.h"
 #include "Compressor.h"
 #include "Decompressor.h"
+#include "RangeReader.h"
+#include "Benchmark.h"
+#include "GzipCompressor.h"
+#include "Parallelism.h"
+#include <string>
 
 std::chrono::time_point<std::chrono::steady_clock> t1;
 std::chrono::time_point<std::chrono::steady_clock> t2;
@@ -14,8 +19,177 @@ long long duration;
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count(); \
     std::cout << "Time: " << duration << " milliseconds" << std::endl;
 
-int main()
+int main(int argc, char* argv[])
 {
+    /// overrides of the automatic parallelism come first, before the mode
+    while (argc > 2 && (std::string(argv[1]) == "--workers" || std::string(argv[1]) == "--batch-chunks"))
+    {
+        if (std::string(argv[1]) == "--workers")
+        {
+            Parallelism::setWorkersCount(std::stoul(argv[2]));
+        }
+        else
+        {
+            Parallelism::setBatchChunksCount(std::stoul(argv[2]));
+        }
+
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "benchmark")
+    {
+        std::string benchmark = argc > 2 ? argv[2] : "streams";
+
+        if (benchmark == "streams")
+        {
+            Benchmark::streamPool();
+        }
+        else if (benchmark == "chunksizes")
+        {
+            Benchmark::chunkSizeSweep(BIG_FILE_PATH);
+        }
+        else if (benchmark == "solid")
+        {
+            Benchmark::solidGroupSweep(BIG_FILE_PATH);
+        }
+        else if (benchmark == "dictionary")
+        {
+            Benchmark::dictionarySweep(BIG_FILE_PATH);
+        }
+        else if (benchmark == "scaling")
+        {
+            Benchmark::coreScaling(BIG_FILE_PATH);
+        }
+        else if (benchmark == "mapping")
+        {
+            Benchmark::archiveMapping(BIG_FILE_PATH);
+        }
+        else if (benchmark == "chunkcache")
+        {
+            Benchmark::chunkCache(BIG_FILE_PATH);
+        }
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "verify")
+    {
+        std::wstring archivePath = argc > 2 ? std::wstring(argv[2], argv[2] + strlen(argv[2])) : COMPRESSED_BIG_FILE;
+
+        Decompressor decompressor;
+
+        CHRONO_BEGIN;
+        std::vector<size_t> corruptedChunks = decompressor.verify(archivePath.c_str());
+        CHRONO_END;
+
+        for (size_t chunkIndex : corruptedChunks)
+        {
+            std::cout << "corrupted chunk " << chunkIndex << std::endl;
+        }
+        std::cout << corruptedChunks.size() << " corrupted chunks" << std::endl;
+
+        return corruptedChunks.empty() ? 0 : 1;
+    }
+
+    if (argc > 2 && (std::string(argv[1]) == "throughput" || std::string(argv[1]) == "deadline"))
+    {
+        /// throughput in MB/s of input, deadline in seconds
+        double target = std::stod(argv[2]);
+
+        Compressor compressor;
+        compressor.setThroughputController(std::string(argv[1]) == "throughput"
+            ? ThroughputController::forThroughput(target * 1024 * 1024)
+            : ThroughputController::forDeadline(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(target))));
+
+        CHRONO_BEGIN;
+        compressor.compress(BIG_FILE_PATH, COMPRESSED_BIG_FILE);
+        CHRONO_END;
+
+        std::vector<ThroughputController::LevelStatistics> statistics = compressor.throughputController()->statistics();
+
+        /// the Huffman only chunks go after the levels
+        statistics.push_back(compressor.throughputController()->huffmanOnlyStatistics());
+
+        for (size_t level = 0; level < statistics.size(); ++level)
+        {
+            const ThroughputController::LevelStatistics& levelStatistics = statistics[level];
+
+            if (levelStatistics.m_chunksCount == 0)
+            {
+                continue;
+            }
+
+            double seconds = std::chrono::duration<double>(levelStatistics.m_deflateTime).count();
+
+            std::cout << (level <= COMPRESSION_LEVEL ? "level " + std::to_string(level) : std::string("huffman only")) << ": " << levelStatistics.m_chunksCount << " chunks, "
+                << levelStatistics.m_inputBytes / (1024.0 * 1024.0) << " MB, ratio "
+                << (levelStatistics.m_outputBytes ? double(levelStatistics.m_inputBytes) / levelStatistics.m_outputBytes : 0.0) << ", "
+                << (seconds > 0 ? levelStatistics.m_inputBytes / (1024.0 * 1024.0) / seconds : 0.0) << " MB/s per thread" << std::endl;
+        }
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "gzip")
+    {
+        std::wstring inputPath = argc > 2 ? std::wstring(argv[2], argv[2] + strlen(argv[2])) : BIG_FILE_PATH;
+        std::wstring outputPath = argc > 3 ? std::wstring(argv[3], argv[3] + strlen(argv[3])) : GZIP_BIG_FILE;
+
+        GzipCompressor compressor;
+
+        CHRONO_BEGIN;
+        compressor.compress(inputPath.c_str(), outputPath.c_str());
+        CHRONO_END;
+
+        return 0;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "pack")
+    {
+        std::wstring directoryPath(argv[2], argv[2] + strlen(argv[2]));
+        std::wstring archivePath = argc > 3 ? std::wstring(argv[3], argv[3] + strlen(argv[3])) : COMPRESSED_BIG_FILE;
+
+        Compressor compressor;
+
+        CHRONO_BEGIN;
+        compressor.compressDirectory(directoryPath.c_str(), archivePath.c_str());
+        CHRONO_END;
+
+        return 0;
+    }
+
+    if (argc > 4 && std::string(argv[1]) == "extract")
+    {
+        std::wstring archivePath(argv[2], argv[2] + strlen(argv[2]));
+        std::wstring assetName(argv[3], argv[3] + strlen(argv[3]));
+        std::wstring outputPath(argv[4], argv[4] + strlen(argv[4]));
+
+        RangeReader reader(archivePath.c_str());
+        AssetIndex::Asset asset;
+
+        if (!reader.findAsset(assetName.c_str(), asset))
+        {
+            std::cout << "no asset " << argv[3] << std::endl;
+            return 1;
+        }
+
+        std::vector<uint8_t> content(asset.m_size);
+
+        CHRONO_BEGIN;
+        reader.read(asset.m_offset, content.data(), content.size());
+        CHRONO_END;
+
+        DeleteFile(outputPath.c_str());
+        ManagedHandle outputFile = createWriteFile(outputPath.c_str());
+
+        DWORD written = 0;
+        throwIfFalse(content.empty() || WriteFile(outputFile.get(), content.data(), static_cast<DWORD>(content.size()), &written, nullptr));
+
+        return 0;
+    }
+
     Compressor compressor;
     Decompressor decompressor;
 
@@ -27,5 +201,28 @@ int main()
     decompressor.decompress(COMPRESSED_BIG_FILE, DECOMPRESSED_BIG_FILE);
     CHRONO_END;
 
+    /// read a 4 KB asset from the middle of the file without decompressing the whole archive
+    RangeReader reader(COMPRESSED_BIG_FILE);
+    std::vector<uint8_t> asset(4 * 1024);
+    const size_t assetOffset = reader.fileSize() / 2;
+
+    CHRONO_BEGIN;
+    size_t assetSize = reader.read(assetOffset, asset.data(), asset.size());
+    CHRONO_END;
+
+    /// the asset has to be the same bytes as in the original file
+    ManagedHandle bigFile = createReadFile(BIG_FILE_PATH);
+    ManagedHandle bigFileMapping = createReadFileMapping(bigFile.get(), 0);
+
+    LARGE_INTEGER viewOffset;
+    viewOffset.QuadPart = alignDown(assetOffset, ALLOCATION_GRANULARITY);
+    ManagedViewHandle bigFileView = createReadMapViewOfFile(bigFileMapping.get(), viewOffset, assetOffset - viewOffset.QuadPart + assetSize);
+
+    if (memcmp(asset.data(), reinterpret_cast<uint8_t*>(bigFileView.get()) + (assetOffset - viewOffset.QuadPart), assetSize) != 0)
+    {
+        std::cout << "range read mismatch" << std::endl;
+        return 1;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #pragma once
+
+// Use the C++ standard templated min/max
+#define NOMINMAX
+
 #include <iostream>
 #include <cstdint>
 #include <chrono>
@@ -6,16 +10,21 @@
 #include <memory>
 #include <cassert>
 #include <vector>
+#include <algorithm>
 #include "zlib.h"
+#include "SlabAllocator.h"
 
-static const LPCTSTR FAT_FILE_PATH = L"DataPCFat.fat";
 static const LPCTSTR BIG_FILE_PATH = L"DataPC.forge";
 static const LPCWSTR COMPRESSED_BIG_FILE = L"DataPCCompressed.forge";
 static const LPCWSTR DECOMPRESSED_BIG_FILE = L"DataPCDecompressed.forge";
+static const LPCWSTR GZIP_BIG_FILE = L"DataPC.forge.gz";
 static const size_t PAGE_SIZE = 64 * 1024;
+static const size_t ALLOCATION_GRANULARITY = 64 * 1024;    /// file views have to start on this boundary
+static const size_t MIN_CHUNK_SIZE = 4 * 1024;
+static const size_t MAX_CHUNK_SIZE = 4 * 1024 * 1024;
 static const int COMPRESSION_LEVEL = 9;
-static const size_t CHUNKS_PER_MAP_COUNT = 10;
-static const size_t MAP_SIZE = PAGE_SIZE * CHUNKS_PER_MAP_COUNT;
+static const size_t INPUT_WINDOW_SIZE = MAX_CHUNK_SIZE * 16;
+static const size_t GZIP_BLOCK_SIZE = 128 * 1024;
 
 namespace
 {
@@ -37,16 +46,16 @@ namespace
         {
             void operator()(void* ptr)
             {
-                BOOL ret = VirtualFree(ptr, 0, MEM_RELEASE);
-                throwIfFalse(ret);
+                SlabAllocator::free(ptr);
             }
         };
 
-        Chunk(size_t pageSize) : m_memory(VirtualAlloc(nullptr, pageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE), Deleter()),
+        Chunk(size_t pageSize) : m_memory(SlabAllocator::allocate(pageSize), Deleter()),
             chunkSize(pageSize)
         {
         }
 
+        /* takes ownership of memory from SlabAllocator::allocate */
         Chunk(void* m, size_t pageSize) : m_memory(m, Deleter()), chunkSize(pageSize)
         {
         }
@@ -125,7 +134,7 @@ namespace
             safeHandle(CreateFile(
                 fileName,
                 GENERIC_READ,
-                0,
+                FILE_SHARE_READ,        /// readers of the same file keep their handles open side by side
                 nullptr,
                 OPEN_ALWAYS,            /// open file if exist, else create new
                 FILE_ATTRIBUTE_NORMAL,
@@ -155,6 +164,33 @@ namespace
         return file;
     }
 
+    /* a new file of fileSize bytes reading as zeros, sparse where the file system allows it so the zeros take
+       no disk space until written */
+    ManagedHandle createSparseFile(LPCWSTR fileName, size_t fileSize)
+    {
+        ManagedHandle file(
+            safeHandle(
+                CreateFile(fileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)),
+                FileHandleCloser());
+
+        if (!file)
+        {
+            throw std::exception();
+        }
+
+        /// FAT32 and friends don't do sparse files, the file system then zero fills the unwritten ranges itself
+        DWORD returned;
+        DeviceIoControl(file.get(), FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+
+        /// same as HowToMakeInstantFile.cpp, the file grows to its final size without writing anything
+        LARGE_INTEGER size;
+        size.QuadPart = fileSize;
+        throwIfFalse(SetFilePointerEx(file.get(), size, nullptr, FILE_BEGIN));
+        throwIfFalse(SetEndOfFile(file.get()));
+
+        return file;
+    }
+
     ManagedHandle createReadFileMapping(HANDLE file, size_t mapSize)
     {
         LARGE_INTEGER size;
@@ -27,7 +27,7 @@ void Decompressor::init(ID3D11DeviceX* const device)
 
     assert(m_dmaErrorCodeBuffer != nullptr);
 
-    m_fat.readFromFile(FAT_FILE);
+    m_fat.readFromArchive(INPUT_COMPRESSED_FILE);
 }
 
 void Decompressor::decompress(LPCWSTR inputCompressedFilePath, LPCWSTR outputDecompressedFilePath, ID3D11DeviceX* const device)
@@ -136,13 +136,13 @@ void Decompressor::decompressChunks1(uint8_t* compressedFileContent, Fat& fat, s
     {
     //for (size_t i = fatStartIndex; i < fatEndIndex; ++i)
     //{
-        size_t compressedChunkSize = fat.m_chunksOffsets[i + 1] - fat.m_chunksOffsets[i] - sizeof(UINT);
+        size_t compressedChunkSize = fat.m_chunksOffsets[i + 1] - fat.m_chunksOffsets[i];
         
         size_t decompressDestSize = (fatEndIndex == fat.m_chunksOffsetsCount - 1 && i == fatEndIndex - 1 && fat.m_lastChunkSizeBeforeCompression) 
             ? fat.m_lastChunkSizeBeforeCompression 
             : PAGE_SIZE;
 
-        size_t offset = fat.m_chunksOffsets[i] - fat.m_chunksOffsets[fatStartIndex] + sizeof(UINT);
+        size_t offset = fat.m_chunksOffsets[i] - fat.m_chunksOffsets[fatStartIndex];
         size_t decompressedChunkIndex = i % CHUNKS_PER_MAP_COUNT;
         uint8_t* compressedChunkInitialData = compressedFileContent + offset;
 
@@ -172,6 +172,8 @@ void Decompressor::decompressChunks1(uint8_t* compressedFileContent, Fat& fat, s
             decompressedChunkIndex, 
             m_dmaErrorCodeBuffer.get(), 
             compressedChunkInitialData,
+            fat.m_chunksTypes[i],
+            fat.m_chunksParameters[i],
             device);
 
         taskQueue.push(std::move(task));
@@ -308,9 +310,9 @@ void Decompressor::submitTaskToQueue(uint8_t* compressedFileContent, size_t fatS
 
     concurrency::parallel_for(fatStartIndex, fatEndIndex, [this, &compressedFileContent, &fatStartIndex, &fatEndIndex, &device](size_t i)
     {
-        size_t offset = m_fat.m_chunksOffsets[i] - m_fat.m_chunksOffsets[fatStartIndex] + sizeof(UINT);
+        size_t offset = m_fat.m_chunksOffsets[i] - m_fat.m_chunksOffsets[fatStartIndex];
 
-        size_t compressedChunkSize = m_fat.m_chunksOffsets[i + 1] - m_fat.m_chunksOffsets[i] - sizeof(UINT);
+        size_t compressedChunkSize = m_fat.m_chunksOffsets[i + 1] - m_fat.m_chunksOffsets[i];
 
         size_t decompressDestSize = (fatEndIndex == m_fat.m_chunksOffsetsCount - 1 && i == fatEndIndex - 1 && m_fat.m_lastChunkSizeBeforeCompression)
             ? m_fat.m_lastChunkSizeBeforeCompression
@@ -326,6 +328,8 @@ void Decompressor::submitTaskToQueue(uint8_t* compressedFileContent, size_t fatS
             decompressedChunkIndex,
             m_dmaErrorCodeBuffer.get(),
             compressedChunkInitialData,
+            m_fat.m_chunksTypes[i],
+            m_fat.m_chunksParameters[i],
             device);
 
         m_taskQueue.push(std::move(task));
@@ -334,6 +338,12 @@ void Decompressor::submitTaskToQueue(uint8_t* compressedFileContent, size_t fatS
 
 void Decompressor::writeTaskResultToFile(DecompressTask& task, HANDLE outputFile)
 {
+    /// the output file is preallocated, a hole already reads as zeros
+    if (task.isHole())
+    {
+        return;
+    }
+
     LARGE_INTEGER moveOffset;
     moveOffset.QuadPart = task.m_destChunkIndex * PAGE_SIZE;
 
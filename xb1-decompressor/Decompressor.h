@@ -8,33 +8,48 @@ class Decompressor
     struct DecompressTask
     {
         DecompressTask() : m_decompressSource(nullptr), m_decompressDest(nullptr), 
-            m_sourceSize(0), m_destSize(0), m_destChunkIndex(0), m_dmaErrorCodeBuffer(nullptr), m_device(nullptr) {}
+            m_sourceSize(0), m_destSize(0), m_destChunkIndex(0), m_dmaErrorCodeBuffer(nullptr), m_type(ChunkType::Deflated), m_fillByte(0), m_device(nullptr) {}
 
         DecompressTask(const DecompressTask& other)
             : m_decompressSource(other.m_decompressSource), m_decompressDest(other.m_decompressDest), m_sourceSize(other.m_sourceSize), 
-            m_destSize(other.m_destSize), m_destChunkIndex(other.m_destChunkIndex), m_dmaErrorCodeBuffer(other.m_dmaErrorCodeBuffer), m_device(other.m_device)
+            m_destSize(other.m_destSize), m_destChunkIndex(other.m_destChunkIndex), m_dmaErrorCodeBuffer(other.m_dmaErrorCodeBuffer), 
+            m_type(other.m_type), m_fillByte(other.m_fillByte), m_device(other.m_device)
         {
         }
 
-        void initTask(UINT sourceSize, UINT destSize, size_t destIndex, UINT* dmaErrorCodeBuffer, uint8_t* sourceInitData, ID3D11DeviceX* device)
+        void initTask(UINT sourceSize, UINT destSize, size_t destIndex, UINT* dmaErrorCodeBuffer, uint8_t* sourceInitData, ChunkType type, uint8_t fillByte, ID3D11DeviceX* device)
         {
             m_sourceSize = sourceSize;
             m_destSize = destSize;
             m_destChunkIndex = destIndex;
             m_dmaErrorCodeBuffer = dmaErrorCodeBuffer;
+            m_type = type;
+            m_fillByte = fillByte;
             m_device = device;
 
-            m_decompressSource = createManagedMemShared<uint8_t>(
+            /// zero fill chunks stay holes of the preallocated output file, nothing to allocate
+            if (isHole())
+            {
+                return;
+            }
+
+            m_decompressDest = createManagedMemShared<uint8_t>(
                 VirtualAlloc(
                     nullptr,
-                    sourceSize,
+                    destSize,
                     MEM_RESERVE | MEM_COMMIT | MEM_GRAPHICS | MEM_LARGE_PAGES,
                     PAGE_READWRITE | PAGE_GPU_COHERENT));
 
-            m_decompressDest = createManagedMemShared<uint8_t>(
+            /// fill chunks have no payload
+            if (m_type == ChunkType::Fill)
+            {
+                return;
+            }
+
+            m_decompressSource = createManagedMemShared<uint8_t>(
                 VirtualAlloc(
                     nullptr,
-                    destSize,
+                    sourceSize,
                     MEM_RESERVE | MEM_COMMIT | MEM_GRAPHICS | MEM_LARGE_PAGES,
                     PAGE_READWRITE | PAGE_GPU_COHERENT));
 
@@ -44,6 +59,24 @@ class Decompressor
 
         void doWork(ID3D11DmaEngineContextX* const dmaContext)
         {
+            if (isHole())
+            {
+                return;
+            }
+
+            if (m_type == ChunkType::Fill)
+            {
+                FillMemory(m_decompressDest.get(), m_destSize, m_fillByte);
+                return;
+            }
+
+            /// the chunk was kept raw in the archive, nothing for the DMA engine to do
+            if (m_type == ChunkType::Stored)
+            {
+                CopyMemory(m_decompressDest.get(), m_decompressSource.get(), m_sourceSize);
+                return;
+            }
+
             throwIfFailed(dmaContext->LZDecompressMemory(m_decompressDest.get(), m_decompressSource.get(), m_sourceSize, 0));
             dmaContext->CopyLastErrorCodeToMemory(m_dmaErrorCodeBuffer);
 
@@ -73,6 +106,13 @@ class Decompressor
         UINT m_destSize;
         size_t m_destChunkIndex;
         UINT* m_dmaErrorCodeBuffer;
+        bool isHole() const
+        {
+            return m_type == ChunkType::Fill && m_fillByte == 0;
+        }
+
+        ChunkType m_type;
+        uint8_t m_fillByte;
         ID3D11DeviceX* m_device;
     };
 
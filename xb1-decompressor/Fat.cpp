@@ -1,14 +1,39 @@
 #include "pch.h"
 #include "Fat.h"
 
-void Fat::readFromFile(LPCWSTR fatFilePath)
+void Fat::readFromArchive(LPCWSTR archivePath)
 {
-    ManagedHandle fatHandle = createReadFile(L"\DataPCFat.fat", 0);
+    ManagedHandle archiveHandle = createReadFile(archivePath, 0);
+    size_t archiveSize = fileSize(archiveHandle.get()).QuadPart;
+
+    throwIfFalse(archiveSize >= sizeof(ArchiveFormat::ArchiveHeader) + sizeof(ArchiveFormat::ArchiveFooter));
 
     DWORD readCount;
 
-    throwIfFalse(ReadFile(fatHandle.get(), &m_originalFileSize, sizeof(m_originalFileSize), &readCount, nullptr));
-    throwIfFalse(ReadFile(fatHandle.get(), &m_chunksOffsetsCount, sizeof(m_chunksOffsetsCount), &readCount, nullptr));
+    /// the footer describes where the FAT is
+    ArchiveFormat::ArchiveFooter footer;
+    LARGE_INTEGER footerOffset;
+    footerOffset.QuadPart = archiveSize - sizeof(footer);
+
+    throwIfFalse(SetFilePointerEx(archiveHandle.get(), footerOffset, nullptr, FILE_BEGIN));
+    throwIfFalse(ReadFile(archiveHandle.get(), &footer, sizeof(footer), &readCount, nullptr));
+    throwIfFalse(ArchiveFormat::isValid(footer, archiveSize));
+
+    /// the DMA decompression works on PAGE_SIZE chunks
+    throwIfFalse(footer.m_header.m_chunkSize == PAGE_SIZE);
+
+    /// a DMA task only sees the payload of its own chunk, deduplicated archives aren't supported yet
+    throwIfFalse(footer.m_referencesCount == 0);
+
+    /// nor are solid groups, each DMA task inflates one independent zlib stream
+    throwIfFalse(footer.m_header.m_solidChunksCount == 1);
+
+    /// and the DMA engine has no way to preset a dictionary
+    throwIfFalse(footer.m_header.m_dictionarySize == 0);
+
+    m_originalFileSize = footer.m_header.m_originalFileSize;
+    m_chunksOffsetsCount = static_cast<DWORD>(footer.m_header.m_chunksCount + 1);
+    m_lastChunkSizeBeforeCompression = static_cast<DWORD>(m_originalFileSize % PAGE_SIZE);
 
     std::unique_ptr<size_t[]> mem(
         reinterpret_cast<size_t*>(
@@ -22,7 +47,29 @@ void Fat::readFromFile(LPCWSTR fatFilePath)
         mem.release(),
         MemCloser());
 
-    assert(m_chunksOffsetsCount > 0);
-    throwIfFalse(ReadFile(fatHandle.get(), m_chunksOffsets.get(), m_chunksOffsetsCount * sizeof(size_t), &readCount, nullptr));
-    throwIfFalse(ReadFile(fatHandle.get(), &m_lastChunkSizeBeforeCompression, sizeof(m_lastChunkSizeBeforeCompression), &readCount, nullptr));
+    m_chunksTypes.resize(m_chunksOffsetsCount - 1);
+    m_chunksParameters.resize(m_chunksOffsetsCount - 1);
+
+    /// the DMA tasks get flat offsets, the packed FAT is decoded once here
+    std::vector<uint8_t> fat(static_cast<size_t>(footer.m_fatSize));
+
+    LARGE_INTEGER fatOffset;
+    fatOffset.QuadPart = footer.m_fatOffset;
+
+    throwIfFalse(SetFilePointerEx(archiveHandle.get(), fatOffset, nullptr, FILE_BEGIN));
+    throwIfFalse(ReadFile(archiveHandle.get(), fat.data(), static_cast<DWORD>(fat.size()), &readCount, nullptr));
+    throwIfFalse(readCount == fat.size());
+
+    ArchiveFormat::FatView fatView(fat.data(), footer.m_header.m_chunksCount, footer.m_deltaBits, footer.m_referencesCount);
+
+    for (DWORD i = 0; i < m_chunksOffsetsCount; ++i)
+    {
+        m_chunksOffsets[i] = static_cast<size_t>(fatView.chunkOffset(i));
+    }
+
+    for (size_t i = 0; i < m_chunksTypes.size(); ++i)
+    {
+        m_chunksTypes[i] = fatView.chunkType(i);
+        m_chunksParameters[i] = fatView.chunkParameter(i);
+    }
 }
@@ -1,14 +1,16 @@
 #pragma once
 #include "pch.h"
+#include "../ArchiveFormat.h"
 
 struct Fat
 {
 public:
-    void readFromFile(LPCWSTR fatFilePath);
+    void readFromArchive(LPCWSTR archivePath);
     
     ManagedMemArray<size_t> m_chunksOffsets;
+    std::vector<ChunkType> m_chunksTypes;
+    std::vector<uint8_t> m_chunksParameters;
     DWORD m_chunksOffsetsCount;
     DWORD m_lastChunkSizeBeforeCompression;
     size_t m_originalFileSize;
 };
-
@@ -34,7 +34,6 @@ static const size_t CHUNKS_PER_MAP_COUNT = 10;
 static const size_t MAP_SIZE = PAGE_SIZE * CHUNKS_PER_MAP_COUNT;
 static const LPCWSTR INPUT_COMPRESSED_FILE = L"DataPCCompressed.forge";
 static const LPCWSTR OUTPUT_DECOMPRESSED_FILE = L"DataPCDecompressed.forge";
-static const LPCWSTR FAT_FILE = L"DataPCFat.fat";
 
 
 namespace DX